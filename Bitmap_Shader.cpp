@@ -7,10 +7,12 @@
 #include "GPoint.h"
 #include "GMatrix.h"
 #include "GShader.h"
+#include "Pixel_Math.h"
+#include "Float_Pipeline.h"
 #include <stdio.h>
 #include <cstdint>
 
-class BitmapShader : public GShader{
+class BitmapShader : public GShader, public FloatShader{
 public:
     const GMatrix internal_matrix;
     GMatrix local_matrix;
@@ -18,7 +20,6 @@ public:
     GMatrix final_matrix;
     GMatrix invert_shader_m;
     GMatrix tmp_matrix;
-    float shader_alpha;
     const GBitmap shader_bitmap;
     const GShader::TileMode tile_mode;
     const int src_width;
@@ -30,8 +31,8 @@ public:
         local_matrix = GMatrix(src_width,0,0,0,src_height,0);
     }
 
+    // paint alpha is applied to the shaded row by the canvas
     bool setContext(const GMatrix& new_ctm_matrix, float alpha){
-        shader_alpha = alpha;
         shader_m.setConcat(new_ctm_matrix,internal_matrix);
         tmp_matrix.setConcat(shader_m,local_matrix);
         shader_m.invert(&invert_shader_m);
@@ -50,6 +51,15 @@ public:
         }
     }
 
+    // texels are 8-bit, so widening the sampled row loses nothing
+    void shadeRowF(int x, int y, int count, PixelF row[]){
+        GPixel tmp[count];
+        shadeRow(x,y,count,tmp);
+        for(int i = 0; i < count; ++i){
+            row[i] = pixel_to_float(tmp[i]);
+        }
+    }
+
     void shadeRow_clamp(int x, int y, int count, GPixel row[]){
         //did not transform into the 0,1 interval
         GPoint loc = invert_shader_m.mapXY(x+0.5,y+0.5);
@@ -60,9 +70,7 @@ public:
             int int_curr_y = (int)(loc.fY);
             int_curr_x =  fmin(shader_bitmap.width()-1,fmax(0,int_curr_x));
             int_curr_y =  fmin(shader_bitmap.height()-1,fmax(0,int_curr_y));
-            GPixel src_pix =  *shader_bitmap.getAddr(int_curr_x, int_curr_y);
-            GPixel blended_src_pix = blend_with_alpha(src_pix);
-            row[i] = blended_src_pix;
+            row[i] = *shader_bitmap.getAddr(int_curr_x, int_curr_y);
             loc.fX += dx;
             loc.fY += dy;
         }
@@ -81,9 +89,7 @@ public:
             int int_curr_y = (int) (w_y * src_height);
             int_curr_x =  fmin(shader_bitmap.width()-1, fmax(0,int_curr_x));
             int_curr_y =  fmin(shader_bitmap.height()-1, fmax(0,int_curr_y));
-            GPixel src_pix = *shader_bitmap.getAddr(int_curr_x, int_curr_y);
-            GPixel blended_src_pix = blend_with_alpha(src_pix);
-            row[i] = blended_src_pix;
+            row[i] = *shader_bitmap.getAddr(int_curr_x, int_curr_y);
             w_x += dx;
             w_y += dy;
         }     
@@ -116,22 +122,11 @@ public:
             int int_curr_y = (int) (w_y_curr * src_height);
             int_curr_x =  fmin(shader_bitmap.width()-1, fmax(0,int_curr_x));
             int_curr_y =  fmin(shader_bitmap.height()-1, fmax(0,int_curr_y));
-            GPixel src_pix = *shader_bitmap.getAddr(int_curr_x, int_curr_y);
-            GPixel blended_src_pix = blend_with_alpha(src_pix);
-            row[i] = blended_src_pix;
+            row[i] = *shader_bitmap.getAddr(int_curr_x, int_curr_y);
             w_x += dx;
             w_y += dy;
         }     
     }
-    
-    GPixel blend_with_alpha(GPixel& pix){
-        int new_a = (uint8_t) (GPixel_GetA(pix)*shader_alpha);
-        int new_r = (uint8_t) (GPixel_GetR(pix)*shader_alpha);
-        int new_g = (uint8_t) (GPixel_GetG(pix)*shader_alpha);
-        int new_b = (uint8_t) (GPixel_GetB(pix)*shader_alpha);
-        GPixel the_pixel = GPixel_PackARGB(new_a, new_r, new_g, new_b);
-        return the_pixel;
-    }
 };
     
 GShader* GShader::FromBitmap(const GBitmap& bitmap, const GMatrix& localMatrix, GShader::TileMode new_tileMode){
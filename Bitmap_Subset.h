@@ -0,0 +1,27 @@
+#ifndef Bitmap_Subset_DEFINED
+#define Bitmap_Subset_DEFINED
+
+#include "GBitmap.h"
+#include "GRect.h"
+#include <algorithm>
+
+// Points dst at the part of src inside subset, sharing src's pixels: fPixels moves to the
+// subset's top left and fRowBytes stays src's, so the view works anywhere a GBitmap does,
+// as a canvas target or a shader source, without copying. The subset is clipped to src;
+// false (and dst untouched) when nothing is left. dst must not outlive src's pixels.
+static inline bool extract_subset(const GBitmap& src, const GIRect& subset, GBitmap* dst){
+    int left = std::max(subset.left(), 0);
+    int top = std::max(subset.top(), 0);
+    int right = std::min(subset.right(), src.width());
+    int bottom = std::min(subset.bottom(), src.height());
+    if(left >= right || top >= bottom || !src.pixels()){
+        return false;
+    }
+    dst->fWidth = right - left;
+    dst->fHeight = bottom - top;
+    dst->fRowBytes = src.rowBytes();
+    dst->fPixels = src.getAddr(left, top);
+    return true;
+}
+
+#endif
@@ -0,0 +1,78 @@
+#ifndef Canvas_Extras_DEFINED
+#define Canvas_Extras_DEFINED
+
+#include "GCanvas.h"
+#include "GBitmap.h"
+#include "GMatrix.h"
+#include "GPaint.h"
+#include "GRect.h"
+#include "Curve_Path.h"
+
+// Draws GCanvas has no virtual for. canvas must come from GCanvas::Create or one of the
+// create_*_canvas factories.
+
+// drawRect for each of count rects with one paint; the paint is set up once for the batch
+void canvas_draw_rects(GCanvas* canvas, const GRect rects[], int count, const GPaint& paint);
+
+// fills path with its fill rule, or strokes it when paint has a stroke width;
+// curves are flattened in device space
+void canvas_draw_path(GCanvas* canvas, const CurvePath& path, const GPaint& paint);
+
+// drawContours with a fill rule other than nonzero winding; inverse rules cover the whole
+// bitmap outside the contours. Strokes ignore the rule.
+void canvas_draw_contours(GCanvas* canvas, const GContour ctrs[], int count, const GPaint& paint,
+                          FillRule rule);
+
+// Coons patch with corners top-left, top-right, bottom-right, bottom-left. off_curve holds two
+// cubic control points per edge (top, right, bottom, left; each running left to right or top
+// to bottom), or is null for straight edges. colors and tex are per corner and may be null.
+// The patch is split into level x level quads (at most 64); 0 picks enough for the CTM.
+void canvas_draw_quad_patch(GCanvas* canvas, const GPoint corners[4], const GPoint off_curve[8],
+                            const GColor colors[4], const GPoint tex[4], const GPaint& paint,
+                            int level = 0);
+
+// Draws count sprites: the src[i] rect of atlas with its top left corner at the origin of
+// xforms[i] (then the CTM), sampled nearest, multiplied by colors[i] unless colors is null.
+// The paint's alpha applies to every sprite and its shader is ignored. Later sprites draw on
+// top of earlier ones.
+void canvas_draw_atlas(GCanvas* canvas, const GBitmap& atlas, const GMatrix xforms[],
+                       const GIRect src[], const GColor colors[], int count, const GPaint& paint);
+
+// Draws src into dst. The x_divs (and y_divs) split src into segments that alternate between
+// fixed and stretchable, starting with a fixed one; fixed segments keep their size and the
+// stretchable ones share the rest of dst. When dst is too small for the fixed segments they
+// all shrink together. divs must be ascending and within src, or nothing is drawn.
+void canvas_draw_bitmap_lattice(GCanvas* canvas, const GBitmap& src, const int x_divs[], int x_count,
+                                const int y_divs[], int y_count, const GRect& dst,
+                                const GPaint& paint);
+
+// nine patch: the lattice with center as the only stretchable part of src
+void canvas_draw_bitmap_nine(GCanvas* canvas, const GBitmap& src, const GIRect& center,
+                             const GRect& dst, const GPaint& paint);
+
+// save() that also redirects drawing into an offscreen covering bounds (mapped by the CTM), or
+// the whole canvas when bounds is null. The matching restore() composites the offscreen back
+// with the paint's alpha, so overlapping draws inside fade as one group.
+void canvas_save_layer(GCanvas* canvas, const GRect* bounds, const GPaint& paint);
+
+// Records draws instead of rasterizing them until canvas_flush_deferred or
+// canvas_end_deferred, which first drop the draws later opaque rects or clears hide. Rects,
+// polygons, contours, paths and clears are recorded; other draws flush and run at once.
+// Shaders in recorded paints are only referenced and must outlive the flush.
+void canvas_begin_deferred(GCanvas* canvas);
+void canvas_flush_deferred(GCanvas* canvas);
+// flushes and goes back to drawing immediately
+void canvas_end_deferred(GCanvas* canvas);
+
+// Keeps the device space edges of up to max_entries recently filled contour lists, keyed by
+// their points and the CTM's linear part, so redrawing one (also translated) skips mapping and
+// sorting. 0, the default, turns the cache off.
+void canvas_set_geometry_cache(GCanvas* canvas, int max_entries);
+
+// Keeps the coverage of up to max_entries recently filled CurvePaths, keyed by the path, the
+// CTM's linear part and its translation snapped to 1/4 pixel, and blits it at whole pixel
+// offsets. Cached fills may land up to 1/8 pixel off. Inverse fills are never cached. 0, the
+// default, turns the cache off.
+void canvas_set_mask_cache(GCanvas* canvas, int max_entries);
+
+#endif
@@ -7,12 +7,14 @@
 #include "GPoint.h"
 #include "GMatrix.h"
 #include "GShader.h"
+#include "Pixel_Math.h"
+#include "Float_Pipeline.h"
 #include "TriColorShader.cpp"
 #include "ProxyShader.cpp"
 #include <stdio.h>
 #include <cstdint>
 
-class CompositeShader: public GShader{
+class CompositeShader: public GShader, public FloatShader{
     public:
     TriColorShader* color_shader;
     ProxyShader* tex_shader;
@@ -38,18 +40,14 @@ class CompositeShader: public GShader{
         }
     }
 
+    void shadeRowF(int x, int y, int count, PixelF row[]){
+        PixelF row_tex[count];
+        color_shader->shadeRowF(x,y,count,row);
+        tex_shader->shadeRowF(x,y,count,row_tex);
+        mul_row_f(row,row_tex,count);
+    }
+
     GPixel blend(const GPixel& pix1, const GPixel& pix2){
-		float fa = (GPixel_GetA(pix1)/255.0)*(GPixel_GetA(pix2)/255.0);
-        float fr = (GPixel_GetR(pix1)/255.0)*(GPixel_GetR(pix2)/255.0);
-        float fg = (GPixel_GetG(pix1)/255.0)*(GPixel_GetG(pix2)/255.0);
-        float fb = (GPixel_GetB(pix1)/255.0)*(GPixel_GetB(pix2)/255.0);
-        GColor fcolor = GColor::MakeARGB(fa,fr,fg,fb);
-        GColor correctedColor = fcolor.pinToUnit();
-        int a = (uint8_t) (correctedColor.fA*255);
-        int r = (uint8_t) (correctedColor.fR*255);
-        int g = (uint8_t) (correctedColor.fG*255);
-        int b = (uint8_t) (correctedColor.fB*255);
-        return GPixel_PackARGB(a,r,g,b);
-		
-}
+        return mul_pixels(pix1, pix2);
+    }
 };
\ No newline at end of file
@@ -0,0 +1,524 @@
+#ifndef Curve_Path_DEFINED
+#define Curve_Path_DEFINED
+
+#include "GPoint.h"
+#include "GPath.h"
+#include "GContour.h"
+#include "GRect.h"
+#include <math.h>
+#include <algorithm>
+#include <vector>
+
+// How winding counts map to inside for fills and hit tests.
+enum class FillRule {
+    kWinding,           // inside where the winding count is nonzero
+    kEvenOdd,           // inside where the winding count is odd
+    kInverseWinding,    // outside of kWinding
+    kInverseEvenOdd,    // outside of kEvenOdd
+};
+
+static inline bool fill_rule_inside(int winding, FillRule rule){
+    switch (rule){
+        case FillRule::kWinding:
+            return winding != 0;
+        case FillRule::kEvenOdd:
+            return (winding & 1) != 0;
+        case FillRule::kInverseWinding:
+            return winding == 0;
+        case FillRule::kInverseEvenOdd:
+            return (winding & 1) == 0;
+    }
+    return false;
+}
+
+// Path with quadratic and cubic segments. Curves are kept as control points
+// and only flattened by the canvas, in device space, at draw time.
+class CurvePath {
+public:
+    enum class Verb {
+        kMove,      // 1 point
+        kLine,      // 1 point
+        kQuad,      // 2 points
+        kCubic,     // 3 points
+    };
+
+    CurvePath& moveTo(const GPoint& pt){
+        fIndexValid = false;
+        if(fVerbs.size() > 0 && fVerbs.back() == Verb::kMove){
+            fPts.back() = pt;
+        }
+        else{
+            fPts.push_back(pt);
+            fVerbs.push_back(Verb::kMove);
+        }
+        return *this;
+    }
+
+    CurvePath& lineTo(const GPoint& pt){
+        GASSERT(fVerbs.size() > 0);
+        fPts.push_back(pt);
+        fVerbs.push_back(Verb::kLine);
+        fIndexValid = false;
+        return *this;
+    }
+
+    CurvePath& quadTo(const GPoint& p1, const GPoint& p2){
+        GASSERT(fVerbs.size() > 0);
+        fPts.push_back(p1);
+        fPts.push_back(p2);
+        fVerbs.push_back(Verb::kQuad);
+        fIndexValid = false;
+        return *this;
+    }
+
+    CurvePath& cubicTo(const GPoint& p1, const GPoint& p2, const GPoint& p3){
+        GASSERT(fVerbs.size() > 0);
+        fPts.push_back(p1);
+        fPts.push_back(p2);
+        fPts.push_back(p3);
+        fVerbs.push_back(Verb::kCubic);
+        fIndexValid = false;
+        return *this;
+    }
+
+    // append every contour of a line-only GPath
+    CurvePath& addPath(const GPath& path){
+        GPath::Iter iter(path);
+        GContour ctr;
+        while(iter.next(&ctr)){
+            this->moveTo(ctr.fPts[0]);
+            for(int i = 1; i < ctr.fCount; ++i){
+                this->lineTo(ctr.fPts[i]);
+            }
+        }
+        return *this;
+    }
+
+    static int pts_per_verb(Verb verb){
+        switch (verb){
+            case Verb::kMove:
+            case Verb::kLine:
+                return 1;
+            case Verb::kQuad:
+                return 2;
+            case Verb::kCubic:
+                return 3;
+        }
+        return 0;
+    }
+
+    // rule used when the path is filled, nonzero winding by default
+    FillRule getFillRule() const { return fFillRule; }
+    void setFillRule(FillRule rule) { fFillRule = rule; }
+
+    bool isEmpty() const { return fVerbs.empty(); }
+    int countPoints() const { return (int)fPts.size(); }
+    int countVerbs() const { return (int)fVerbs.size(); }
+    const GPoint* points() const { return fPts.data(); }
+    const Verb* verbs() const { return fVerbs.data(); }
+
+    // bounds of the points, control points included
+    GRect bounds() const;
+    // bounds of the curves themselves, tighter than bounds() when control points stick out
+    GRect computeTightBounds() const;
+    // hit test against the filled path; each contour is implicitly closed
+    bool contains(float x, float y, FillRule rule = FillRule::kWinding) const;
+
+private:
+    // one flattened, non horizontal edge with y0 < y1
+    struct IndexEdge {
+        float y0, y1;
+        float x0, dxdy;
+        int   winding;
+    };
+
+    // interval tree node: the edges with y0 <= center < y1, and the subtrees of the edges
+    // entirely below (y1 <= center) and above (y0 > center) it
+    struct IndexNode {
+        float center;
+        int   begin, end;   // range of the node's edges in fIndex and fIndexByY1
+        int   below, above; // child nodes, -1 for none
+    };
+
+    void build_index() const;
+    int build_index_node(std::vector<IndexEdge>& edges) const;
+
+    std::vector<GPoint> fPts;
+    std::vector<Verb>   fVerbs;
+    FillRule            fFillRule = FillRule::kWinding;
+    // local space edge interval tree, built by the first contains() after an edit. Each node's
+    // edges are kept twice: in fIndex sorted by y0, and in fIndexByY1 sorted by y1, descending.
+    mutable std::vector<IndexNode> fIndexNodes;
+    mutable std::vector<IndexEdge> fIndex;
+    mutable std::vector<IndexEdge> fIndexByY1;
+    mutable bool fIndexValid = false;
+};
+
+// Largest distance, in pixels, a flattened curve may stray from the true curve.
+#define CURVE_TOLERANCE 0.25f
+
+static inline float curve_len(float x, float y){
+    return sqrtf(x*x + y*y);
+}
+
+// For n uniform segments a quad deviates at most |p0 - 2p1 + p2| / (4n^2) from its chords.
+static inline int quad_segments(const GPoint pts[3], float tol = CURVE_TOLERANCE){
+    float dd = curve_len(pts[0].fX - 2*pts[1].fX + pts[2].fX, pts[0].fY - 2*pts[1].fY + pts[2].fY);
+    int n = (int)ceilf(sqrtf(dd / (4*tol)));
+    return std::max(1, std::min(n, 1024));
+}
+
+// For a cubic the bound is 3*max(|second differences|) / (4n^2).
+static inline int cubic_segments(const GPoint pts[4], float tol = CURVE_TOLERANCE){
+    float d0 = curve_len(pts[0].fX - 2*pts[1].fX + pts[2].fX, pts[0].fY - 2*pts[1].fY + pts[2].fY);
+    float d1 = curve_len(pts[1].fX - 2*pts[2].fX + pts[3].fX, pts[1].fY - 2*pts[2].fY + pts[3].fY);
+    int n = (int)ceilf(sqrtf(3*std::max(d0, d1) / (4*tol)));
+    return std::max(1, std::min(n, 1024));
+}
+
+// Walks a curve in n uniform steps by forward differencing, calling proc(prev, next) for each chord.
+template <typename Proc> void flatten_quad(const GPoint pts[3], int n, Proc proc){
+    float dt = 1.0f / n;
+    // B(t) = A t^2 + B t + C
+    float ax = pts[0].fX - 2*pts[1].fX + pts[2].fX, ay = pts[0].fY - 2*pts[1].fY + pts[2].fY;
+    float bx = 2*(pts[1].fX - pts[0].fX),          by = 2*(pts[1].fY - pts[0].fY);
+    float d1x = ax*dt*dt + bx*dt, d1y = ay*dt*dt + by*dt;
+    float d2x = 2*ax*dt*dt,       d2y = 2*ay*dt*dt;
+    GPoint prev = pts[0];
+    for(int i = 1; i < n; ++i){
+        GPoint next = GPoint::Make(prev.fX + d1x, prev.fY + d1y);
+        proc(prev, next);
+        prev = next;
+        d1x += d2x;
+        d1y += d2y;
+    }
+    proc(prev, pts[2]);
+}
+
+template <typename Proc> void flatten_cubic(const GPoint pts[4], int n, Proc proc){
+    float dt = 1.0f / n;
+    // B(t) = A t^3 + B t^2 + C t + D
+    float ax = pts[3].fX - 3*pts[2].fX + 3*pts[1].fX - pts[0].fX;
+    float ay = pts[3].fY - 3*pts[2].fY + 3*pts[1].fY - pts[0].fY;
+    float bx = 3*(pts[2].fX - 2*pts[1].fX + pts[0].fX), by = 3*(pts[2].fY - 2*pts[1].fY + pts[0].fY);
+    float cx = 3*(pts[1].fX - pts[0].fX),               cy = 3*(pts[1].fY - pts[0].fY);
+    float dt2 = dt*dt, dt3 = dt2*dt;
+    float d1x = ax*dt3 + bx*dt2 + cx*dt, d1y = ay*dt3 + by*dt2 + cy*dt;
+    float d2x = 6*ax*dt3 + 2*bx*dt2,     d2y = 6*ay*dt3 + 2*by*dt2;
+    float d3x = 6*ax*dt3,                d3y = 6*ay*dt3;
+    GPoint prev = pts[0];
+    for(int i = 1; i < n; ++i){
+        GPoint next = GPoint::Make(prev.fX + d1x, prev.fY + d1y);
+        proc(prev, next);
+        prev = next;
+        d1x += d2x;
+        d1y += d2y;
+        d2x += d3x;
+        d2y += d3y;
+    }
+    proc(prev, pts[3]);
+}
+
+static inline GPoint curve_lerp(GPoint a, GPoint b, float t){
+    return GPoint::Make(a.fX + (b.fX - a.fX)*t, a.fY + (b.fY - a.fY)*t);
+}
+
+// Splits a quad at its y extremum. dst receives 3 or 5 points, returns the number of pieces.
+static inline int chop_quad_y_monotonic(const GPoint src[3], GPoint dst[5]){
+    float denom = src[0].fY - 2*src[1].fY + src[2].fY;
+    float t = denom != 0 ? (src[0].fY - src[1].fY) / denom : -1;
+    if(t <= 0 || t >= 1){
+        dst[0] = src[0]; dst[1] = src[1]; dst[2] = src[2];
+        return 1;
+    }
+    GPoint ab = curve_lerp(src[0], src[1], t);
+    GPoint bc = curve_lerp(src[1], src[2], t);
+    GPoint mid = curve_lerp(ab, bc, t);
+    // snap the control points to the extremum so both halves are truly monotonic
+    ab.fY = bc.fY = mid.fY;
+    dst[0] = src[0]; dst[1] = ab; dst[2] = mid; dst[3] = bc; dst[4] = src[2];
+    return 2;
+}
+
+static inline void chop_cubic_at(const GPoint src[4], GPoint dst[7], float t){
+    GPoint ab = curve_lerp(src[0], src[1], t);
+    GPoint bc = curve_lerp(src[1], src[2], t);
+    GPoint cd = curve_lerp(src[2], src[3], t);
+    GPoint abc = curve_lerp(ab, bc, t);
+    GPoint bcd = curve_lerp(bc, cd, t);
+    dst[0] = src[0]; dst[1] = ab; dst[2] = abc;
+    dst[3] = curve_lerp(abc, bcd, t);
+    dst[4] = bcd; dst[5] = cd; dst[6] = src[3];
+}
+
+// Parameters in (0,1), ascending, where a cubic coordinate has zero derivative. Returns the count.
+static inline int cubic_extrema(float p0, float p1, float p2, float p3, float ts[2]){
+    // d/dt = 3(a t^2 + 2 b t + c)
+    float a = p3 - 3*p2 + 3*p1 - p0;
+    float b = p2 - 2*p1 + p0;
+    float c = p1 - p0;
+    float roots[2];
+    int count = 0;
+    if(fabsf(a) < 1e-6f){
+        if(b != 0){
+            roots[count++] = -c / (2*b);
+        }
+    }
+    else{
+        float disc = b*b - a*c;
+        if(disc >= 0){
+            float q = sqrtf(disc);
+            float r0 = (-b - q) / a;
+            float r1 = (-b + q) / a;
+            roots[count++] = std::min(r0, r1);
+            roots[count++] = std::max(r0, r1);
+        }
+    }
+    int n = 0;
+    for(int i = 0; i < count; ++i){
+        if(roots[i] > 0 && roots[i] < 1 && (n == 0 || roots[i] > ts[n-1])){
+            ts[n++] = roots[i];
+        }
+    }
+    return n;
+}
+
+// Splits a cubic at up to two y extrema. dst receives 4, 7 or 10 points, returns the number of pieces.
+static inline int chop_cubic_y_monotonic(const GPoint src[4], GPoint dst[10]){
+    float ts[2];
+    int n = cubic_extrema(src[0].fY, src[1].fY, src[2].fY, src[3].fY, ts);
+    for(int i = 0; i < 4; ++i){
+        dst[i] = src[i];
+    }
+    float prev_t = 0;
+    for(int i = 0; i < n; ++i){
+        GPoint* piece = dst + 3*i;
+        GPoint tmp[7];
+        chop_cubic_at(piece, tmp, (ts[i] - prev_t) / (1 - prev_t));
+        tmp[2].fY = tmp[4].fY = tmp[3].fY;
+        for(int k = 0; k < 7; ++k){
+            piece[k] = tmp[k];
+        }
+        prev_t = ts[i];
+    }
+    return n + 1;
+}
+
+static inline float quad_eval(float p0, float p1, float p2, float t){
+    float mt = 1 - t;
+    return mt*mt*p0 + 2*mt*t*p1 + t*t*p2;
+}
+
+static inline float cubic_eval(float p0, float p1, float p2, float p3, float t){
+    float mt = 1 - t;
+    return mt*mt*mt*p0 + 3*mt*mt*t*p1 + 3*mt*t*t*p2 + t*t*t*p3;
+}
+
+// Calls proc(a, b) for every chord of the path with curves flattened to tol, closing each contour.
+template <typename Proc> void walk_path_chords(const CurvePath& path, float tol, Proc proc){
+    const GPoint* pts = path.points();
+    const CurvePath::Verb* verbs = path.verbs();
+    GPoint start = GPoint::Make(0, 0), last = start;
+    for(int i = 0; i < path.countVerbs(); ++i){
+        GPoint src[4];
+        src[0] = last;
+        switch (verbs[i]){
+            case CurvePath::Verb::kMove:
+                if(i > 0){
+                    proc(last, start);
+                }
+                start = last = pts[0];
+                break;
+            case CurvePath::Verb::kLine:
+                proc(last, pts[0]);
+                last = pts[0];
+                break;
+            case CurvePath::Verb::kQuad:
+                src[1] = pts[0]; src[2] = pts[1];
+                flatten_quad(src, quad_segments(src, tol), proc);
+                last = src[2];
+                break;
+            case CurvePath::Verb::kCubic:
+                src[1] = pts[0]; src[2] = pts[1]; src[3] = pts[2];
+                flatten_cubic(src, cubic_segments(src, tol), proc);
+                last = src[3];
+                break;
+        }
+        pts += CurvePath::pts_per_verb(verbs[i]);
+    }
+    if(path.countVerbs() > 0){
+        proc(last, start);
+    }
+}
+
+inline GRect CurvePath::bounds() const{
+    if(fPts.empty()){
+        return GRect::MakeLTRB(0, 0, 0, 0);
+    }
+    float l = fPts[0].fX, t = fPts[0].fY, r = l, b = t;
+    for(size_t i = 1; i < fPts.size(); ++i){
+        l = std::min(l, fPts[i].fX);
+        r = std::max(r, fPts[i].fX);
+        t = std::min(t, fPts[i].fY);
+        b = std::max(b, fPts[i].fY);
+    }
+    return GRect::MakeLTRB(l, t, r, b);
+}
+
+// on curve points bound the curve except at interior extrema, which are added per axis
+inline GRect CurvePath::computeTightBounds() const{
+    if(fPts.empty()){
+        return GRect::MakeLTRB(0, 0, 0, 0);
+    }
+    float l = fPts[0].fX, t = fPts[0].fY, r = l, b = t;
+    auto add = [&](float x, float y){
+        l = std::min(l, x);
+        r = std::max(r, x);
+        t = std::min(t, y);
+        b = std::max(b, y);
+    };
+    const GPoint* pts = fPts.data();
+    GPoint last = pts[0];
+    for(size_t i = 0; i < fVerbs.size(); ++i){
+        const GPoint* p = pts;
+        switch (fVerbs[i]){
+            case Verb::kMove:
+            case Verb::kLine:
+                add(p[0].fX, p[0].fY);
+                last = p[0];
+                break;
+            case Verb::kQuad: {
+                add(p[1].fX, p[1].fY);
+                float dx = last.fX - 2*p[0].fX + p[1].fX;
+                float dy = last.fY - 2*p[0].fY + p[1].fY;
+                float tx = dx != 0 ? (last.fX - p[0].fX) / dx : -1;
+                float ty = dy != 0 ? (last.fY - p[0].fY) / dy : -1;
+                if(tx > 0 && tx < 1){
+                    add(quad_eval(last.fX, p[0].fX, p[1].fX, tx), quad_eval(last.fY, p[0].fY, p[1].fY, tx));
+                }
+                if(ty > 0 && ty < 1){
+                    add(quad_eval(last.fX, p[0].fX, p[1].fX, ty), quad_eval(last.fY, p[0].fY, p[1].fY, ty));
+                }
+                last = p[1];
+                break;
+            }
+            case Verb::kCubic: {
+                add(p[2].fX, p[2].fY);
+                float ts[4];
+                int n = cubic_extrema(last.fX, p[0].fX, p[1].fX, p[2].fX, ts);
+                n += cubic_extrema(last.fY, p[0].fY, p[1].fY, p[2].fY, ts + n);
+                for(int k = 0; k < n; ++k){
+                    add(cubic_eval(last.fX, p[0].fX, p[1].fX, p[2].fX, ts[k]),
+                        cubic_eval(last.fY, p[0].fY, p[1].fY, p[2].fY, ts[k]));
+                }
+                last = p[2];
+                break;
+            }
+        }
+        pts += pts_per_verb(fVerbs[i]);
+    }
+    return GRect::MakeLTRB(l, t, r, b);
+}
+
+inline void CurvePath::build_index() const{
+    std::vector<IndexEdge> edges;
+    walk_path_chords(*this, CURVE_TOLERANCE, [&edges](GPoint a, GPoint b){
+        if(a.fY == b.fY){
+            return;
+        }
+        IndexEdge e;
+        e.winding = b.fY > a.fY ? 1 : -1;
+        if(b.fY < a.fY){
+            std::swap(a, b);
+        }
+        e.y0 = a.fY;
+        e.y1 = b.fY;
+        e.x0 = a.fX;
+        e.dxdy = (b.fX - a.fX) / (b.fY - a.fY);
+        edges.push_back(e);
+    });
+    fIndexNodes.clear();
+    fIndex.clear();
+    fIndexByY1.clear();
+    this->build_index_node(edges);
+    fIndexValid = true;
+}
+
+// Splits at the median edge midpoint, so each subtree gets at most half of the edges.
+inline int CurvePath::build_index_node(std::vector<IndexEdge>& edges) const{
+    if(edges.empty()){
+        return -1;
+    }
+    std::vector<IndexEdge>::iterator mid = edges.begin() + edges.size() / 2;
+    std::nth_element(edges.begin(), mid, edges.end(), [](const IndexEdge& a, const IndexEdge& b){
+        return a.y0 + a.y1 < b.y0 + b.y1;
+    });
+    IndexNode node;
+    node.center = (mid->y0 + mid->y1) * 0.5f;
+    if(!(node.center < mid->y1)){
+        // y0 and y1 one ulp apart; y0 still keeps the median edge in this node
+        node.center = mid->y0;
+    }
+    node.begin = (int)fIndex.size();
+
+    std::vector<IndexEdge> below, above;
+    for(const IndexEdge& e : edges){
+        if(e.y1 <= node.center){
+            below.push_back(e);
+        }else if(e.y0 > node.center){
+            above.push_back(e);
+        }else{
+            fIndex.push_back(e);
+        }
+    }
+    std::vector<IndexEdge>().swap(edges);
+    node.end = (int)fIndex.size();
+    std::sort(fIndex.begin() + node.begin, fIndex.end(), [](const IndexEdge& a, const IndexEdge& b){
+        return a.y0 < b.y0;
+    });
+    fIndexByY1.insert(fIndexByY1.end(), fIndex.begin() + node.begin, fIndex.end());
+    std::sort(fIndexByY1.begin() + node.begin, fIndexByY1.end(), [](const IndexEdge& a, const IndexEdge& b){
+        return a.y1 > b.y1;
+    });
+
+    const int index = (int)fIndexNodes.size();
+    fIndexNodes.push_back(node);
+    const int below_index = this->build_index_node(below);
+    const int above_index = this->build_index_node(above);
+    fIndexNodes[index].below = below_index;
+    fIndexNodes[index].above = above_index;
+    return index;
+}
+
+// Casts a ray towards +x. The interval tree is walked from the root down one path of
+// O(log n) nodes; at each node only the edges that actually span y are visited, since every
+// edge there spans center and the sorted run stops at the first one that misses y.
+inline bool CurvePath::contains(float x, float y, FillRule rule) const{
+    if(!fIndexValid){
+        this->build_index();
+    }
+    int winding = 0;
+    auto cross = [&winding, x, y](const IndexEdge& e){
+        if(e.x0 + (y - e.y0) * e.dxdy > x){
+            winding += e.winding;
+        }
+    };
+    int n = fIndexNodes.empty() ? -1 : 0;
+    while(n >= 0){
+        const IndexNode& node = fIndexNodes[n];
+        if(y < node.center){
+            for(int i = node.begin; i < node.end && fIndex[i].y0 <= y; ++i){
+                cross(fIndex[i]);
+            }
+            n = node.below;
+        }else{
+            for(int i = node.begin; i < node.end && fIndexByY1[i].y1 > y; ++i){
+                cross(fIndexByY1[i]);
+            }
+            n = node.above;
+        }
+    }
+    return fill_rule_inside(winding, rule);
+}
+
+#endif
@@ -0,0 +1,145 @@
+#ifndef Dirty_Region_DEFINED
+#define Dirty_Region_DEFINED
+
+#include "GCanvas.h"
+#include "GBitmap.h"
+#include "GRect.h"
+#include <algorithm>
+#include <stdint.h>
+#include <vector>
+
+#define DIRTY_MAX_RECTS 8
+
+// Union of the pixels that need work, kept as at most DIRTY_MAX_RECTS rects. Rects that
+// touch are merged; past the limit the two whose union adds the least area are merged,
+// so the region only ever grows to cover more than was added, never less.
+class DirtyRegion {
+public:
+    DirtyRegion() : fLast(0) {}
+
+    bool isEmpty() const { return fRects.empty(); }
+    const std::vector<GIRect>& rects() const { return fRects; }
+
+    void clear(){
+        fRects.clear();
+        fLast = 0;
+    }
+
+    GIRect bounds() const{
+        if(fRects.empty()){
+            return GIRect::MakeLTRB(0, 0, 0, 0);
+        }
+        GIRect r = fRects[0];
+        for(size_t i = 1; i < fRects.size(); ++i){
+            r = join(r, fRects[i]);
+        }
+        return r;
+    }
+
+    bool intersects(const GIRect& r) const{
+        for(size_t i = 0; i < fRects.size(); ++i){
+            if(overlap(fRects[i], r)){
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void add(GIRect r){
+        if(r.isEmpty()){
+            return;
+        }
+        for(size_t i = 0; i < fRects.size(); ){
+            if(touch(fRects[i], r)){
+                r = join(r, fRects[i]);
+                fRects.erase(fRects.begin() + i);
+                i = 0;
+            }
+            else{
+                ++i;
+            }
+        }
+        fRects.push_back(r);
+        if(fRects.size() > DIRTY_MAX_RECTS){
+            merge_cheapest();
+        }
+        fLast = fRects.size() - 1;
+        while(!contains(fRects[fLast], r)){
+            --fLast;
+        }
+    }
+
+    // spans arrive row by row, so most just extend the rect the previous span grew; once
+    // that rect grows into another one the two go through add() to be merged
+    void add_span(int x, int y, int count){
+        GIRect r = GIRect::MakeLTRB(x, y, x + count, y + 1);
+        if(fLast < fRects.size() && touch(fRects[fLast], r)){
+            GIRect grown = join(fRects[fLast], r);
+            if(contains(fRects[fLast], grown)){
+                return;
+            }
+            fRects[fLast] = grown;
+            for(size_t i = 0; i < fRects.size(); ++i){
+                if(i != fLast && touch(fRects[i], grown)){
+                    fRects.erase(fRects.begin() + fLast);
+                    this->add(grown);
+                    return;
+                }
+            }
+            return;
+        }
+        this->add(r);
+    }
+
+private:
+    static int64_t area(const GIRect& r){
+        return (int64_t)r.width() * r.height();
+    }
+
+    static GIRect join(const GIRect& a, const GIRect& b){
+        return GIRect::MakeLTRB(std::min(a.left(), b.left()), std::min(a.top(), b.top()),
+                                std::max(a.right(), b.right()), std::max(a.bottom(), b.bottom()));
+    }
+
+    static bool overlap(const GIRect& a, const GIRect& b){
+        return a.left() < b.right() && b.left() < a.right() && a.top() < b.bottom() && b.top() < a.bottom();
+    }
+
+    static bool contains(const GIRect& a, const GIRect& b){
+        return a.left() <= b.left() && a.top() <= b.top() && b.right() <= a.right() && b.bottom() <= a.bottom();
+    }
+
+    // overlapping or sharing an edge
+    static bool touch(const GIRect& a, const GIRect& b){
+        return a.left() <= b.right() && b.left() <= a.right() && a.top() <= b.bottom() && b.top() <= a.bottom();
+    }
+
+    void merge_cheapest(){
+        size_t best_i = 0, best_j = 1;
+        int64_t best_cost = INT64_MAX;
+        for(size_t i = 0; i < fRects.size(); ++i){
+            for(size_t j = i + 1; j < fRects.size(); ++j){
+                int64_t cost = area(join(fRects[i], fRects[j])) - area(fRects[i]) - area(fRects[j]);
+                if(cost < best_cost){
+                    best_cost = cost;
+                    best_i = i;
+                    best_j = j;
+                }
+            }
+        }
+        // the union can reach a third rect, so it goes back through add()
+        GIRect merged = join(fRects[best_i], fRects[best_j]);
+        fRects.erase(fRects.begin() + best_j);
+        fRects.erase(fRects.begin() + best_i);
+        this->add(merged);
+    }
+
+    std::vector<GIRect> fRects;
+    size_t fLast;       // rect the last span went into
+};
+
+// Canvas drawing into bitmap that also adds every span it writes to region, moved by
+// (dx, dy) so a canvas on a subset can report in its parent's coordinates.
+GCanvas* create_tracking_canvas(const GBitmap& bitmap, DirtyRegion* region, int dx = 0, int dy = 0);
+
+#endif
@@ -0,0 +1,298 @@
+#ifndef Float_Pipeline_DEFINED
+#define Float_Pipeline_DEFINED
+
+#include "GPixel.h"
+#include "GBitmap.h"
+#include "GCanvas.h"
+#include "GColor.h"
+#include "GShader.h"
+#include "Pixel_Math.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#ifdef __F16C__
+#include <immintrin.h>
+#endif
+
+// High precision pipeline: premultiplied float pixels that are only quantized
+// to 8 bits when written out.
+
+struct PixelF {
+    float fA, fR, fG, fB;
+};
+
+// shaders that can produce float rows directly, without going through GPixel
+class FloatShader {
+public:
+    virtual ~FloatShader() {}
+    virtual void shadeRowF(int x, int y, int count, PixelF row[]) = 0;
+};
+
+static inline PixelF premul_to_float(float a, float r, float g, float b){
+    a = GPinToUnit(a);
+    PixelF p = { a, GPinToUnit(r)*a, GPinToUnit(g)*a, GPinToUnit(b)*a };
+    return p;
+}
+
+static inline PixelF pixel_to_float(GPixel pix){
+    const float inv = 1.0f/255;
+    PixelF p = { GPixel_GetA(pix)*inv, GPixel_GetR(pix)*inv, GPixel_GetG(pix)*inv, GPixel_GetB(pix)*inv };
+    return p;
+}
+
+static inline GPixel float_to_pixel(const PixelF& p){
+    unsigned a = unit_to_byte(p.fA);
+    return GPixel_PackARGB(a, std::min(a, unit_to_byte(p.fR)),
+                              std::min(a, unit_to_byte(p.fG)),
+                              std::min(a, unit_to_byte(p.fB)));
+}
+
+// shade with shadeRowF when the shader supports it, otherwise widen its 8-bit row
+static inline void shade_row_f(GShader* shader, int x, int y, int count, PixelF row[]){
+    if(count <= 0){
+        return;
+    }
+    FloatShader* float_shader = dynamic_cast<FloatShader*>(shader);
+    if(float_shader){
+        float_shader->shadeRowF(x, y, count, row);
+        return;
+    }
+    GPixel tmp[count];
+    shader->shadeRow(x, y, count, tmp);
+    for(int i = 0; i < count; ++i){
+        row[i] = pixel_to_float(tmp[i]);
+    }
+}
+
+// dst[i] = src[i] + dst[i]*(1 - src_a)
+static inline void blend_srcover_row_f(PixelF dst[], const PixelF src[], int count){
+#ifdef __SSE2__
+    const __m128 one = _mm_set1_ps(1);
+    for(int i = 0; i < count; ++i){
+        __m128 s = _mm_loadu_ps(&src[i].fA);
+        __m128 d = _mm_loadu_ps(&dst[i].fA);
+        __m128 inv_a = _mm_sub_ps(one, _mm_shuffle_ps(s, s, _MM_SHUFFLE(0, 0, 0, 0)));
+        _mm_storeu_ps(&dst[i].fA, _mm_add_ps(s, _mm_mul_ps(d, inv_a)));
+    }
+#else
+    for(int i = 0; i < count; ++i){
+        float inv_a = 1 - src[i].fA;
+        dst[i].fA = src[i].fA + dst[i].fA*inv_a;
+        dst[i].fR = src[i].fR + dst[i].fR*inv_a;
+        dst[i].fG = src[i].fG + dst[i].fG*inv_a;
+        dst[i].fB = src[i].fB + dst[i].fB*inv_a;
+    }
+#endif
+}
+
+static inline void blend_srcover_color_row_f(PixelF dst[], const PixelF& src, int count){
+    if(src.fA >= 1){
+        for(int i = 0; i < count; ++i){
+            dst[i] = src;
+        }
+        return;
+    }
+#ifdef __SSE2__
+    __m128 s = _mm_loadu_ps(&src.fA);
+    __m128 inv_a = _mm_set1_ps(1 - src.fA);
+    for(int i = 0; i < count; ++i){
+        __m128 d = _mm_loadu_ps(&dst[i].fA);
+        _mm_storeu_ps(&dst[i].fA, _mm_add_ps(s, _mm_mul_ps(d, inv_a)));
+    }
+#else
+    for(int i = 0; i < count; ++i){
+        blend_srcover_row_f(dst + i, &src, 1);
+    }
+#endif
+}
+
+static inline void scale_row_f(PixelF row[], int count, float s){
+#ifdef __SSE2__
+    __m128 s4 = _mm_set1_ps(s);
+    for(int i = 0; i < count; ++i){
+        _mm_storeu_ps(&row[i].fA, _mm_mul_ps(_mm_loadu_ps(&row[i].fA), s4));
+    }
+#else
+    for(int i = 0; i < count; ++i){
+        row[i].fA *= s; row[i].fR *= s; row[i].fG *= s; row[i].fB *= s;
+    }
+#endif
+}
+
+static inline void mul_row_f(PixelF dst[], const PixelF src[], int count){
+    for(int i = 0; i < count; ++i){
+        dst[i].fA *= src[i].fA;
+        dst[i].fR *= src[i].fR;
+        dst[i].fG *= src[i].fG;
+        dst[i].fB *= src[i].fB;
+    }
+}
+
+// IEEE half <-> float, round to nearest even
+static inline uint16_t float_to_half(float f){
+    uint32_t x;
+    memcpy(&x, &f, 4);
+    uint32_t sign = (x >> 16) & 0x8000;
+    int32_t exp = (int32_t)((x >> 23) & 0xFF) - 127 + 15;
+    uint32_t mant = x & 0x007FFFFF;
+    if(((x >> 23) & 0xFF) == 0xFF){
+        return sign | 0x7C00 | (mant ? 0x200 : 0);
+    }
+    if(exp >= 31){
+        return sign | 0x7C00;
+    }
+    if(exp <= 0){
+        if(exp < -10){
+            return sign;
+        }
+        mant |= 0x00800000;
+        int shift = 14 - exp;
+        uint32_t half = mant >> shift;
+        uint32_t rem = mant & ((1u << shift) - 1);
+        uint32_t mid = 1u << (shift - 1);
+        if(rem > mid || (rem == mid && (half & 1))){
+            half++;
+        }
+        return sign | half;
+    }
+    uint32_t half = sign | (exp << 10) | (mant >> 13);
+    uint32_t rem = mant & 0x1FFF;
+    if(rem > 0x1000 || (rem == 0x1000 && (half & 1))){
+        half++;
+    }
+    return half;
+}
+
+static inline float half_to_float(uint16_t h){
+    uint32_t sign = (uint32_t)(h & 0x8000) << 16;
+    uint32_t exp = (h >> 10) & 0x1F;
+    uint32_t mant = h & 0x3FF;
+    uint32_t x;
+    if(exp == 0){
+        float f = ldexpf((float)mant, -24);
+        return sign ? -f : f;
+    }
+    else if(exp == 31){
+        x = sign | 0x7F800000 | (mant << 13);
+    }
+    else{
+        x = sign | ((exp + 112) << 23) | (mant << 13);
+    }
+    float f;
+    memcpy(&f, &x, 4);
+    return f;
+}
+
+enum class FloatFormat {
+    kF32,
+    kF16,
+};
+
+// Owning float destination. Pixels are stored A,R,G,B premultiplied.
+class FloatBitmap {
+public:
+    const int fWidth;
+    const int fHeight;
+    const FloatFormat fFormat;
+    const size_t fRowBytes;
+
+    FloatBitmap(int width, int height, FloatFormat format)
+    :fWidth(width),fHeight(height),fFormat(format)
+    ,fRowBytes(width * (format == FloatFormat::kF32 ? sizeof(PixelF) : 4*sizeof(uint16_t))){
+        fStorage = (char*)calloc(fRowBytes, height);
+    }
+
+    ~FloatBitmap(){
+        free(fStorage);
+    }
+
+    int width() const { return fWidth; }
+    int height() const { return fHeight; }
+    bool isValid() const { return fStorage != nullptr; }
+
+    void load_row(int x, int y, int count, PixelF dst[]) const{
+        const char* row = fStorage + y * fRowBytes;
+        if(fFormat == FloatFormat::kF32){
+            memcpy(dst, (const PixelF*)row + x, count * sizeof(PixelF));
+            return;
+        }
+        const uint16_t* src = (const uint16_t*)row + 4*x;
+        int i = 0;
+#ifdef __F16C__
+        for(; i < count; ++i){
+            __m128i h = _mm_loadl_epi64((const __m128i*)(src + 4*i));
+            _mm_storeu_ps(&dst[i].fA, _mm_cvtph_ps(h));
+        }
+#endif
+        for(; i < count; ++i){
+            dst[i].fA = half_to_float(src[4*i + 0]);
+            dst[i].fR = half_to_float(src[4*i + 1]);
+            dst[i].fG = half_to_float(src[4*i + 2]);
+            dst[i].fB = half_to_float(src[4*i + 3]);
+        }
+    }
+
+    void store_row(int x, int y, int count, const PixelF src[]){
+        char* row = fStorage + y * fRowBytes;
+        if(fFormat == FloatFormat::kF32){
+            memcpy((PixelF*)row + x, src, count * sizeof(PixelF));
+            return;
+        }
+        uint16_t* dst = (uint16_t*)row + 4*x;
+        int i = 0;
+#ifdef __F16C__
+        for(; i < count; ++i){
+            __m128i h = _mm_cvtps_ph(_mm_loadu_ps(&src[i].fA), _MM_FROUND_TO_NEAREST_INT);
+            _mm_storel_epi64((__m128i*)(dst + 4*i), h);
+        }
+#endif
+        for(; i < count; ++i){
+            dst[4*i + 0] = float_to_half(src[i].fA);
+            dst[4*i + 1] = float_to_half(src[i].fR);
+            dst[4*i + 2] = float_to_half(src[i].fG);
+            dst[4*i + 3] = float_to_half(src[i].fB);
+        }
+    }
+
+    // quantize into an 8-bit bitmap of the same size
+    void to_bitmap(const GBitmap& dst) const{
+        PixelF row[fWidth];
+        for(int y = 0; y < fHeight; ++y){
+            load_row(0, y, fWidth, row);
+            GPixel* dst_row = dst.getAddr(0, y);
+            for(int x = 0; x < fWidth; ++x){
+                dst_row[x] = float_to_pixel(row[x]);
+            }
+        }
+    }
+
+    bool writeToFile(const char path[]) const{
+        GBitmap tmp;
+        tmp.fWidth = fWidth;
+        tmp.fHeight = fHeight;
+        tmp.fRowBytes = fWidth * sizeof(GPixel);
+        tmp.fPixels = (GPixel*)malloc(tmp.fRowBytes * fHeight);
+        if(!tmp.fPixels){
+            return false;
+        }
+        to_bitmap(tmp);
+        bool result = tmp.writeToFile(path);
+        free(tmp.fPixels);
+        return result;
+    }
+
+private:
+    char* fStorage;
+
+    FloatBitmap(const FloatBitmap&);
+    FloatBitmap& operator=(const FloatBitmap&);
+};
+
+// canvas that rasterizes exactly like GCanvas::Create but blends in float into dst
+GCanvas* create_float_canvas(FloatBitmap& dst);
+
+#endif
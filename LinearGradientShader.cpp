@@ -7,43 +7,52 @@
 #include "GPoint.h"
 #include "GMatrix.h"
 #include "GShader.h"
+#include "Pixel_Math.h"
+#include "Float_Pipeline.h"
+#include "SRGB_Tables.h"
 #include <stdio.h>
 #include <cstdint>
 
 
-class LinearGradientShader: public GShader{
+class LinearGradientShader: public GShader, public FloatShader{
 public:
     const GPoint p0;
     const GPoint p1;
     const GColor c0;
     const GColor c1;
     const GShader::TileMode tile_mode;
-    float dc_a;
-    float dc_r;
-    float dc_g;
-    float dc_b;
+    // interpolate between the linearized colors instead of the encoded ones
+    const bool srgb_interp;
+    GColor lc0;
+    GColor lc1;
     GMatrix local_matrix;
     GMatrix final_matrix;
-    float shader_alpha;
 
     LinearGradientShader(const GPoint& new_p0, const GPoint& new_p1
-    ,const GColor& new_c0, const GColor& new_c1,GShader::TileMode tile_mode)
-    :p0(new_p0),p1(new_p1),c0(new_c0),c1(new_c1),tile_mode(tile_mode){
+    ,const GColor& new_c0, const GColor& new_c1,GShader::TileMode tile_mode, bool new_srgb_interp = false)
+    :p0(new_p0),p1(new_p1),c0(new_c0),c1(new_c1),tile_mode(tile_mode),srgb_interp(new_srgb_interp){
+        GColor pc0 = c0.pinToUnit();
+        GColor pc1 = c1.pinToUnit();
+        lc0 = GColor::MakeARGB(pc0.fA, srgb_to_linear_exact(pc0.fR), srgb_to_linear_exact(pc0.fG), srgb_to_linear_exact(pc0.fB));
+        lc1 = GColor::MakeARGB(pc1.fA, srgb_to_linear_exact(pc1.fR), srgb_to_linear_exact(pc1.fG), srgb_to_linear_exact(pc1.fB));
         //calculate the local_matrix
         float dx = p1.x() - p0.x();
         float dy = p1.y() - p0.y();
         local_matrix = GMatrix(dx,-dy,p0.x(),dy,dx,p0.y());
     }
 
+    // paint alpha is applied to the shaded row by the canvas
     bool setContext(const GMatrix& new_ctm_matrix, float new_alpha){
-        shader_alpha = new_alpha;
         GMatrix tmp_matrix;
         tmp_matrix.setConcat(new_ctm_matrix,local_matrix);
         return tmp_matrix.invert(&final_matrix);
     }
 
     void shadeRow(int x, int y, int count, GPixel row[]){
-        if (tile_mode == GShader::TileMode::kClamp){
+        if (srgb_interp){
+            shadeRow_srgb(x,y,count,row);
+        }
+        else if (tile_mode == GShader::TileMode::kClamp){
             shadeRow_clamp(x,y,count,row);
         }
         else if (tile_mode == GShader::TileMode::kRepeat){
@@ -57,43 +66,12 @@ public:
     void shadeRow_clamp(int x, int y, int count, GPixel row[]){
         GPoint start_loc = final_matrix.mapXY(x+0.5,y+0.5);
         float w = start_loc.x();
-        dc_a = (c1.fA - c0.fA)*final_matrix[GMatrix::SX];
-        dc_r = (c1.fR - c0.fR)*final_matrix[GMatrix::SX];
-        dc_g = (c1.fG - c0.fG)*final_matrix[GMatrix::SX];
-        dc_b = (c1.fB - c0.fB)*final_matrix[GMatrix::SX];
-        float a = w * c1.fA + (1-w)*c0.fA;
-        float r = w * c1.fR + (1-w)*c0.fR;
-        float g = w * c1.fG + (1-w)*c0.fG;
-        float b = w * c1.fB + (1-w)*c0.fB;
-        if(w<0){
-            row[0] = blend_with_alpha(c0.fA,c0.fR,c0.fG,c0.fB);
-            w += final_matrix[GMatrix::SX];
-            }
-        else if(w>1){
-            row[0] = blend_with_alpha(c1.fA,c1.fR,c1.fG,c1.fB);
+        for(int i = 0; i<count;i++){
+            float t = GPinToUnit(w);
+            row[i] = premul_pixel(t*c1.fA + (1-t)*c0.fA, t*c1.fR + (1-t)*c0.fR,
+                                  t*c1.fG + (1-t)*c0.fG, t*c1.fB + (1-t)*c0.fB);
             w += final_matrix[GMatrix::SX];
         }
-        else{
-            row[0] = blend_with_alpha(a,r,g,b);
-        }
-        for (int i = 1; i < count; ++i){
-            if(w<0){
-                row[i] = blend_with_alpha(c0.fA,c0.fR,c0.fG,c0.fB);
-                w += final_matrix[GMatrix::SX];
-            }
-            else if(w>1){
-                row[i] = blend_with_alpha(c1.fA,c1.fR,c1.fG,c1.fB);
-                w += final_matrix[GMatrix::SX];
-            }
-            else{
-                a += dc_a;
-                r += dc_r;
-                g += dc_g;
-                b += dc_b;
-                row[i] = blend_with_alpha(a,r,g,b);
-                w += final_matrix[GMatrix::SX];
-            }
-        }
     }
 
     void shadeRow_repeat(int x, int y, int count, GPixel row[]){
@@ -105,7 +83,7 @@ public:
             float r_new = w*c1.fR + (1-w)*c0.fR;
             float g_new = w*c1.fG + (1-w)*c0.fG;
             float b_new = w*c1.fB + (1-w)*c0.fB;
-            row[i] = blend_with_alpha(a_new,r_new,g_new,b_new);
+            row[i] = premul_pixel(a_new,r_new,g_new,b_new);
             w += final_matrix[GMatrix::SX];
         }
     }
@@ -124,17 +102,66 @@ public:
             float r_new = curr_w*c1.fR + (1-curr_w)*c0.fR;
             float g_new = curr_w*c1.fG + (1-curr_w)*c0.fG;
             float b_new = curr_w*c1.fB + (1-curr_w)*c0.fB;
-            row[i] = blend_with_alpha(a_new,r_new,g_new,b_new);
+            row[i] = premul_pixel(a_new,r_new,g_new,b_new);
+            w += final_matrix[GMatrix::SX];
+        }
+    }
+
+    void shadeRow_srgb(int x, int y, int count, GPixel row[]){
+        const SRGB_Tables& tables = srgb_tables();
+        GPoint start_loc = final_matrix.mapXY(x+0.5,y+0.5);
+        float w = start_loc.x();
+        for(int i = 0; i<count;i++){
+            float t = tile_w(w);
+            unsigned a = unit_to_byte(t*lc1.fA + (1-t)*lc0.fA);
+            row[i] = GPixel_PackARGB(a, mul_div255(linear_to_srgb_byte(tables, t*lc1.fR + (1-t)*lc0.fR), a),
+                                        mul_div255(linear_to_srgb_byte(tables, t*lc1.fG + (1-t)*lc0.fG), a),
+                                        mul_div255(linear_to_srgb_byte(tables, t*lc1.fB + (1-t)*lc0.fB), a));
             w += final_matrix[GMatrix::SX];
         }
     }
 
-    GPixel blend_with_alpha(float a0,float r0,float g0,float b0){
+    void shadeRowF(int x, int y, int count, PixelF row[]){
+        GPoint start_loc = final_matrix.mapXY(x+0.5,y+0.5);
+        float w = start_loc.x();
+        for(int i = 0; i<count;i++){
+            float t = tile_w(w);
+            if (srgb_interp){
+                row[i] = premul_to_float(t*lc1.fA + (1-t)*lc0.fA,
+                                         linear_to_srgb_exact(t*lc1.fR + (1-t)*lc0.fR),
+                                         linear_to_srgb_exact(t*lc1.fG + (1-t)*lc0.fG),
+                                         linear_to_srgb_exact(t*lc1.fB + (1-t)*lc0.fB));
+                w += final_matrix[GMatrix::SX];
+                continue;
+            }
+            row[i] = premul_to_float(t*c1.fA + (1-t)*c0.fA, t*c1.fR + (1-t)*c0.fR,
+                                     t*c1.fG + (1-t)*c0.fG, t*c1.fB + (1-t)*c0.fB);
+            w += final_matrix[GMatrix::SX];
+        }
+    }
+
+    float tile_w(float w){
+        if (tile_mode == GShader::TileMode::kClamp){
+            return GPinToUnit(w);
+        }
+        else if (tile_mode == GShader::TileMode::kRepeat){
+            return w - floorf(w);
+        }
+        w *= 0.5;
+        w -= floorf(w);
+        w *= 2;
+        if(w>=1){
+            w = 2-w;
+        }
+        return w;
+    }
+
+    GPixel premul_pixel(float a0,float r0,float g0,float b0){
         //need to make sure the color has been pin to unit
-        int new_a = (uint8_t) (GPinToUnit(a0 * shader_alpha)*255);
-        int new_r = (uint8_t) (GPinToUnit(r0*a0 * shader_alpha)*255);
-        int new_g = (uint8_t) (GPinToUnit(g0 *a0 *shader_alpha)*255);
-        int new_b = (uint8_t) (GPinToUnit(b0 *a0* shader_alpha)*255);
+        int new_a = unit_to_byte(a0);
+        int new_r = unit_to_byte(r0*a0);
+        int new_g = unit_to_byte(g0 *a0);
+        int new_b = unit_to_byte(b0 *a0);
         GPixel the_pixel = GPixel_PackARGB(new_a, new_r, new_g, new_b);
         return the_pixel;
     }
@@ -143,4 +170,9 @@ public:
 GShader* GShader::LinearGradient(const GPoint& p0, const GPoint& p1,const GColor& c0, const GColor& c1
 , TileMode mode){
     return new LinearGradientShader(p0,p1,c0,c1,mode);
+}
+
+GShader* linear_gradient_srgb(const GPoint& p0, const GPoint& p1, const GColor& c0, const GColor& c1
+, GShader::TileMode mode){
+    return new LinearGradientShader(p0,p1,c0,c1,mode,true);
 }
\ No newline at end of file
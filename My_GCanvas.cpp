@@ -10,17 +10,21 @@
 #include "GShader.h"
 #include "GContour.h"
 #include "GMath.h"
+#include "Pixel_Math.h"
+#include "Float_Pipeline.h"
 #include "CompositeShader.cpp"
+#include "Span_Blitter.cpp"
+#include "Curve_Path.h"
+#include "Canvas_Extras.h"
+#include "Owned_Bitmap.h"
 #include <stdio.h>
+#include <string.h>
 #include <stack>
 #include <list>
 #include <vector>
 #include <assert.h>
 
 #define TWO_FIVE_FIVE 255
-#define OPT_FACTOR 65793
-#define LEFT_SHIFT 23
-#define RIGHT_SHIFT 24
 
 struct edge {
 	int start_y;
@@ -28,6 +32,12 @@ struct edge {
 	float slope;
 	float curr_x;
 	int winding;
+	// quad/cubic edges: chords still to walk, 0 once the last chord is loaded (and for lines)
+	int curve_count;
+	int seg_end_y;
+	float seg_x, seg_y;
+	float last_x, last_y;
+	float d1x, d1y, d2x, d2y, d3x, d3y;
 
 	bool operator< (const edge& a) const{
 		if(start_y == a.start_y){
@@ -38,6 +48,67 @@ struct edge {
     
 };
 
+// Device space geometry of one filled contour list, kept by drawContours when the
+// geometry cache is on. segs holds each edge as a pair of indices into src_pts, sorted by
+// the edge's top y under ctm, so a translated draw maps src_pts again and rebuilds the
+// edges exactly as an uncached draw would, without sorting them again.
+struct edge_cache_entry {
+	uint32_t hash;
+	std::vector<int> src_counts;
+	std::vector<GPoint> src_pts;
+	GMatrix ctm;	// the edges were built under this
+	std::vector<int> segs;
+	std::vector<edge> edges;
+};
+
+// Coverage of one filled CurvePath, kept by drawPath when the mask cache is on. The
+// mask is rasterized with the CTM's linear part and a translation snapped to
+// 1/MASK_SUBPIXEL_STEPS of a pixel, so it can be blitted at any whole pixel offset.
+#define MASK_SUBPIXEL_STEPS 4
+#define MASK_MAX_SIZE 4096
+
+struct mask_cache_entry {
+	uint32_t hash;
+	std::vector<GPoint> src_pts;
+	std::vector<CurvePath::Verb> src_verbs;
+	FillRule rule;
+	float linear[4];
+	int sub_x, sub_y;
+	CoverageMask mask;
+};
+
+// An offscreen opened by saveLayer. While it is open the canvas draws through a
+// Layer_Blitter into offscreen, and restore composites it back with alpha.
+struct layer_record {
+	size_t save_depth;			// matrix_stack size that the matching restore pops
+	int left, top;				// device position of the offscreen, clipped to the canvas
+	OwnedBitmap* offscreen;
+	unsigned alpha;
+	SpanBlitter* prev_blitter;
+	FloatBitmap* prev_float_dst;
+};
+
+// A draw recorded in deferred mode. flushDeferred replays it unless later opaque draws
+// cover all of bounds.
+#define OCCLUSION_TILE 16
+#define OCCLUSION_MAX_RECTS 32
+
+struct deferred_draw {
+	enum Kind { kRect, kPolygon, kContours, kPath, kClear } kind;
+	GMatrix ctm;
+	GPaint paint;
+	FillRule rule;
+	GRect rect;
+	std::vector<GPoint> pts;	// polygon, or every contour's points back to back
+	std::vector<int> counts;	// point count of each contour
+	std::vector<char> closed;
+	CurvePath path;
+	GColor color;				// clear
+	GIRect bounds;				// device pixels the draw may touch
+	bool opaque;				// replaces every pixel of bounds
+	bool culled;
+};
+
 struct tri{
 	GPoint vertices[3];
 };
@@ -45,14 +116,33 @@ struct tri{
 class My_GCanvas : public GCanvas
 {	
 	private:
-		const GBitmap& bitmap;
+		const GBitmap bitmap;
+		// when set, spans are blended in float into this instead of into bitmap's pixels
+		FloatBitmap* float_dst;
+		// 8-bit destination writer picked for the destination's pixel format
+		SpanBlitter* blitter;
 
 	public:
 		std::stack<GMatrix> matrix_stack;
 		GMatrix my_CTM;
 		// new method added for PA 4
 		void setCTM(const GMatrix& new_matrix);
+		// deferred mode: draws are recorded and only rasterized by flushDeferred, which
+		// first drops the ones later opaque draws hide
+		bool deferring;
+		std::vector<deferred_draw> deferred;
+		void beginDeferred();
+		void flushDeferred();
+		void endDeferred();
+		deferred_draw& record_draw(deferred_draw::Kind kind, const GPaint& paint);
+		GIRect deferred_bounds(const GPoint pts[], int count, float outset);
+		GIRect map_bounds(const GRect& rect);
+		void cull_deferred();
+		void replay_deferred(const deferred_draw& draw);
 		void drawRect(const GRect& new_rec, const GPaint& new_paint);
+		void drawRects(const GRect rects[], int count, const GPaint& paint);
+		bool device_rect(const GRect& rect, GIRect& dst_rect);
+		void fill_device_rect(const GIRect& rect, const GPaint& paint, GPixel color);
 		void drawConvexPolygon(const GPoint new_points[], int count, const GPaint& new_paint);
 		void scan_line_shader_color(float x_left, float x_right,int curr_y, const GColor& src_color);
 		// new method added for PA 4
@@ -66,14 +156,45 @@ class My_GCanvas : public GCanvas
 		void scan_line_shader(float x_start, float x_end, int curr_y, const GPaint& paint);
 		bool check_invalid_pts(GPoint points[],int count);
 		void drawContours(const GContour ctrs[], int count, const GPaint& paint);
+		void drawContours(const GContour ctrs[], int count, const GPaint& paint, FillRule rule);
 		void connect_contour(std::vector<edge> &total_edge, const GContour &curr_ctr, int count, int &total_edge_num);
-		void color_survivor(std::list<edge> &survivor, int curr_y,const GPaint& paint);
+		void fill_edges(std::vector<edge> &total_edge, int total_edge_num, const GPaint& paint, FillRule rule);
+		void fill_sorted_edges(std::vector<edge> &total_edge, int total_edge_num, const GPaint& paint, FillRule rule);
+		// most recently used first, at most edge_cache_limit entries; 0 turns the cache off
+		std::list<edge_cache_entry> edge_cache;
+		int edge_cache_limit;
+		void setGeometryCache(int max_entries);
+		std::vector<edge>& cached_edges(const GContour ctrs[], int count);
+		void build_cached_edges(edge_cache_entry& entry);
+		// most recently used first, at most mask_cache_limit entries; 0 turns the cache off
+		std::list<mask_cache_entry> mask_cache;
+		int mask_cache_limit;
+		void setMaskCache(int max_entries);
+		const CoverageMask* cached_mask(const CurvePath& path, int& dx, int& dy);
+		void blit_mask(const CoverageMask& mask, int dx, int dy, const GPaint& paint);
+		void drawPath(const CurvePath& path, const GPaint& paint);
+		void push_edge(std::vector<edge> &total_edge, GPoint a, GPoint b, int &total_edge_num);
+		void push_curve_edge(std::vector<edge> &total_edge, const GPoint pts[], int order, int &total_edge_num);
+		void step_curve_edge(edge& e, int y);
+		void flatten_path(const CurvePath& path, std::vector<std::vector<GPoint> > &polys);
+		void color_survivor(std::list<edge> &survivor, int curr_y,const GPaint& paint, FillRule rule);
+		void add_run(float x_left, float x_right);
+		void blit_runs(int curr_y, const GPaint& paint);
+		void shade_span(int x_start, int x_end, int curr_y, const GPaint& paint);
+		// merged [start, end) pixel runs of the row being filled, reused across rows
+		std::vector<int> row_runs;
+		// shadeRow destination reused by every shaded span
+		std::vector<GPixel> row_buffer;
 		void check_survivor(std::list<edge> &survivor, std::vector<edge> &total_edge, int total_edge_num, int curr_y, int &total_edge_idx);
 		void translate(float tx, float ty);
 		void scale(float sx, float sy);
 		void rotate(float radians);
 		void save();
+		void saveLayer(const GRect* bounds, const GPaint& paint);
 		void restore();
+		void pop_layer();
+		std::vector<layer_record> layers;
+		PixelPool layer_pool;
 		void concat(const GMatrix& new_matrix);
 		/**********************************PA6**************************************************/
 		void explode_contour(const GContour ori_ctrs[], GContour* dst_ctr,int count, int &dst_count, float width, float miterLimit);
@@ -84,10 +205,61 @@ class My_GCanvas : public GCanvas
 		 void drawMesh(int triCount, const GPoint pts[], const int indices[],
 		 const GColor colors[], const GPoint tex[], const GPaint& paint);
 		/**********************************PA7**************************************************/
-		My_GCanvas(const GBitmap& inputBitmap): bitmap(inputBitmap){
+		void drawQuadPatch(const GPoint corners[4], const GPoint off_curve[8], const GColor colors[4],
+		const GPoint tex[4], const GPaint& paint, int level = 0);
+		int patch_level(const GPoint corners[4], const GPoint off_curve[8]);
+		void drawAtlas(const GBitmap& atlas, const GMatrix xforms[], const GIRect src[],
+		const GColor colors[], int count, const GPaint& paint);
+		void drawBitmapLattice(const GBitmap& src, const int x_divs[], int x_count, const int y_divs[], int y_count,
+		const GRect& dst, const GPaint& paint);
+		void drawBitmapNine(const GBitmap& src, const GIRect& center, const GRect& dst, const GPaint& paint);
+		void finish_sprite_row(int x, int y, int count, GPixel row[], const GPixel* tint, unsigned alpha);
+		void blend_pixels(int x, int y, int count, const GPixel row[]);
+		// triangles reused by every drawMesh call; a level 64 patch has 8192 of them
+		std::vector<tri> mesh_tris;
+		// vertex buffers reused by every drawQuadPatch call
+		std::vector<GPoint> patch_pts;
+		std::vector<GColor> patch_colors;
+		std::vector<GPoint> patch_tex;
+		std::vector<int> patch_indices;
+		std::vector<GPoint> patch_edges[4];
+		void scan_line_shader_f(int x_start, int x_end, int curr_y, const GPaint& paint);
+		void scan_line_color_f(int x_start, int x_end, int curr_y, const GColor& src_color);
+		My_GCanvas(const GBitmap& inputBitmap): bitmap(inputBitmap), float_dst(nullptr), deferring(false), edge_cache_limit(0), mask_cache_limit(0){
+			blitter = new ARGB_Blitter(inputBitmap);
+		}
+		My_GCanvas(const GBitmap& bounds, FloatBitmap* new_float_dst): bitmap(bounds), float_dst(new_float_dst), deferring(false), edge_cache_limit(0), mask_cache_limit(0){
+			blitter = nullptr;
+		}
+		My_GCanvas(const GBitmap& bounds, SpanBlitter* new_blitter): bitmap(bounds), float_dst(nullptr), deferring(false), edge_cache_limit(0), mask_cache_limit(0){
+			blitter = new_blitter;
+		}
+		~My_GCanvas(){
+			flushDeferred();
+			while(!layers.empty()){
+				pop_layer();
+			}
+			delete blitter;
 		}
 };
 
+// Draws that are never recorded replay what has been recorded so far and then run at
+// once, with recording paused so the fills they issue internally run at once too.
+struct immediate_scope {
+	My_GCanvas* canvas;
+	bool was_deferring;
+
+	immediate_scope(My_GCanvas* new_canvas): canvas(new_canvas), was_deferring(new_canvas->deferring){
+		if(was_deferring){
+			canvas->flushDeferred();
+			canvas->deferring = false;
+		}
+	}
+	~immediate_scope(){
+		canvas->deferring = was_deferring;
+	}
+};
+
 GCanvas* GCanvas::Create(const GBitmap& bitmap){
     if(bitmap.fWidth<0 || bitmap.fHeight<0|| bitmap.fRowBytes<bitmap.fWidth*4){
         return NULL;
@@ -96,13 +268,108 @@ GCanvas* GCanvas::Create(const GBitmap& bitmap){
         return new My_GCanvas(bitmap);
     }
 }
+
+GCanvas* create_float_canvas(FloatBitmap& dst){
+	if(!dst.isValid() || dst.width()<0 || dst.height()<0){
+		return NULL;
+	}
+	// only the dimensions are used, all pixel access goes through float_dst
+	GBitmap bounds;
+	bounds.fWidth = dst.width();
+	bounds.fHeight = dst.height();
+	bounds.fRowBytes = dst.width()*4;
+	bounds.fPixels = NULL;
+	return new My_GCanvas(bounds, &dst);
+}
+
+GCanvas* create_format_canvas(const FormatBitmap& dst){
+	if(dst.fWidth<0 || dst.fHeight<0 || dst.fRowBytes<dst.fWidth*bytes_per_pixel(dst.fFormat)){
+		return NULL;
+	}
+	SpanBlitter* new_blitter = make_span_blitter(dst);
+	if(!new_blitter){
+		return NULL;
+	}
+	// only the dimensions are used, all pixel access goes through the blitter
+	GBitmap bounds;
+	bounds.fWidth = dst.fWidth;
+	bounds.fHeight = dst.fHeight;
+	bounds.fRowBytes = dst.fWidth*4;
+	bounds.fPixels = NULL;
+	return new My_GCanvas(bounds, new_blitter);
+}
+GCanvas* create_tracking_canvas(const GBitmap& bitmap, DirtyRegion* region, int dx, int dy){
+	if(bitmap.fWidth<0 || bitmap.fHeight<0 || bitmap.fRowBytes<bitmap.fWidth*4 || !region){
+		return NULL;
+	}
+	return new My_GCanvas(bitmap, new Dirty_Blitter(new ARGB_Blitter(bitmap), region, dx, dy));
+}
+
+// every GCanvas this file hands out is a My_GCanvas
+void canvas_draw_rects(GCanvas* canvas, const GRect rects[], int count, const GPaint& paint){
+	static_cast<My_GCanvas*>(canvas)->drawRects(rects, count, paint);
+}
+
+void canvas_draw_path(GCanvas* canvas, const CurvePath& path, const GPaint& paint){
+	static_cast<My_GCanvas*>(canvas)->drawPath(path, paint);
+}
+
+void canvas_draw_contours(GCanvas* canvas, const GContour ctrs[], int count, const GPaint& paint,
+FillRule rule){
+	static_cast<My_GCanvas*>(canvas)->drawContours(ctrs, count, paint, rule);
+}
+
+void canvas_draw_quad_patch(GCanvas* canvas, const GPoint corners[4], const GPoint off_curve[8],
+const GColor colors[4], const GPoint tex[4], const GPaint& paint, int level){
+	static_cast<My_GCanvas*>(canvas)->drawQuadPatch(corners, off_curve, colors, tex, paint, level);
+}
+
+void canvas_draw_atlas(GCanvas* canvas, const GBitmap& atlas, const GMatrix xforms[], const GIRect src[],
+const GColor colors[], int count, const GPaint& paint){
+	static_cast<My_GCanvas*>(canvas)->drawAtlas(atlas, xforms, src, colors, count, paint);
+}
+
+void canvas_draw_bitmap_lattice(GCanvas* canvas, const GBitmap& src, const int x_divs[], int x_count,
+const int y_divs[], int y_count, const GRect& dst, const GPaint& paint){
+	static_cast<My_GCanvas*>(canvas)->drawBitmapLattice(src, x_divs, x_count, y_divs, y_count, dst, paint);
+}
+
+void canvas_draw_bitmap_nine(GCanvas* canvas, const GBitmap& src, const GIRect& center, const GRect& dst,
+const GPaint& paint){
+	static_cast<My_GCanvas*>(canvas)->drawBitmapNine(src, center, dst, paint);
+}
+
+void canvas_save_layer(GCanvas* canvas, const GRect* bounds, const GPaint& paint){
+	static_cast<My_GCanvas*>(canvas)->saveLayer(bounds, paint);
+}
+
+void canvas_begin_deferred(GCanvas* canvas){
+	static_cast<My_GCanvas*>(canvas)->beginDeferred();
+}
+
+void canvas_flush_deferred(GCanvas* canvas){
+	static_cast<My_GCanvas*>(canvas)->flushDeferred();
+}
+
+void canvas_end_deferred(GCanvas* canvas){
+	static_cast<My_GCanvas*>(canvas)->endDeferred();
+}
+
+void canvas_set_geometry_cache(GCanvas* canvas, int max_entries){
+	static_cast<My_GCanvas*>(canvas)->setGeometryCache(max_entries);
+}
+
+void canvas_set_mask_cache(GCanvas* canvas, int max_entries){
+	static_cast<My_GCanvas*>(canvas)->setMaskCache(max_entries);
+}
+
 // PA4 new function
 void My_GCanvas::translate(float tx, float ty){
 	my_CTM.preTranslate(tx,ty);
 }
 
 void My_GCanvas::scale(float sx, float sy){
-	my_CTM.preTranslate(sx,sy);
+	my_CTM.preScale(sx,sy);
 }
 
 void My_GCanvas::rotate(float radians){
@@ -121,6 +388,83 @@ void My_GCanvas::save(){
 void My_GCanvas::restore(){
 	my_CTM = matrix_stack.top();
 	matrix_stack.pop();
+	if(!layers.empty() && layers.back().save_depth == matrix_stack.size() + 1){
+		flushDeferred();
+		pop_layer();
+	}
+}
+
+// Like save, but later draws land in a transparent offscreen covering bounds (mapped by the
+// CTM, or the whole canvas when NULL) until the matching restore blends it back with the
+// paint's alpha. The offscreen comes from layer_pool and is clipped to the enclosing layer.
+void My_GCanvas::saveLayer(const GRect* bounds, const GPaint& paint){
+	// what came before belongs to the parent, draws inside the layer are culled among themselves
+	flushDeferred();
+	save();
+	int left = 0, top = 0, right = bitmap.width(), bottom = bitmap.height();
+	if(!layers.empty()){
+		const layer_record& parent = layers.back();
+		left = parent.left;
+		top = parent.top;
+		right = parent.left + parent.offscreen->bitmap().width();
+		bottom = parent.top + parent.offscreen->bitmap().height();
+	}
+	if(bounds){
+		GPoint corners[4] = { GPoint::Make(bounds->left(), bounds->top()), GPoint::Make(bounds->right(), bounds->top()),
+		                      GPoint::Make(bounds->right(), bounds->bottom()), GPoint::Make(bounds->left(), bounds->bottom()) };
+		my_CTM.mapPoints(corners, corners, 4);
+		float l = corners[0].x(), t = corners[0].y(), r = l, b = t;
+		for(int i = 1; i < 4; ++i){
+			l = std::min(l, corners[i].x());
+			r = std::max(r, corners[i].x());
+			t = std::min(t, corners[i].y());
+			b = std::max(b, corners[i].y());
+		}
+		left = std::max(left, (int)floorf(l));
+		top = std::max(top, (int)floorf(t));
+		right = std::min(right, (int)ceilf(r));
+		bottom = std::min(bottom, (int)ceilf(b));
+	}
+	layer_record layer;
+	layer.save_depth = matrix_stack.size();
+	layer.left = left;
+	layer.top = top;
+	// stays empty, dropping every span, when the bounds miss the canvas
+	layer.offscreen = new OwnedBitmap(right - left, bottom - top, &layer_pool);
+	layer.alpha = unit_to_byte(paint.getAlpha());
+	layer.prev_blitter = blitter;
+	layer.prev_float_dst = float_dst;
+	blitter = new Layer_Blitter(layer.offscreen->bitmap(), layer.left, layer.top);
+	float_dst = nullptr;
+	layers.push_back(layer);
+}
+
+void My_GCanvas::pop_layer(){
+	layer_record layer = layers.back();
+	layers.pop_back();
+	delete blitter;
+	blitter = layer.prev_blitter;
+	float_dst = layer.prev_float_dst;
+	const GBitmap& offscreen = layer.offscreen->bitmap();
+	int width = offscreen.width();
+	if(layer.alpha != 0 && width > 0){
+		if((int)row_buffer.size() < width){
+			row_buffer.resize(width);
+		}
+		GPixel* row = row_buffer.data();
+		for(int y = 0; y < offscreen.height(); ++y){
+			const GPixel* src = offscreen.getAddr(0, y);
+			if(layer.alpha == TWO_FIVE_FIVE){
+				blend_pixels(layer.left, layer.top + y, width, src);
+			}
+			else{
+				memcpy(row, src, width * sizeof(GPixel));
+				scale_row(row, width, layer.alpha);
+				blend_pixels(layer.left, layer.top + y, width, row);
+			}
+		}
+	}
+	delete layer.offscreen;
 }
 
 void My_GCanvas::concat(const GMatrix& new_matrix){
@@ -175,38 +519,117 @@ GPixel My_GCanvas::premulPixel(const GColor& inputColor){
 }
 
 GPixel My_GCanvas::blend_src_dst(const GPixel& src, const GPixel& dst){
-		int src_a = GPixel_GetA(src);
-		int blendA = (uint8_t) (src_a + (((TWO_FIVE_FIVE-src_a) * GPixel_GetA(dst) *  OPT_FACTOR + (1<<LEFT_SHIFT)) >> RIGHT_SHIFT));
-		int blendR = (uint8_t) (GPixel_GetR(src) + (((TWO_FIVE_FIVE-src_a) * GPixel_GetR(dst) *  OPT_FACTOR + (1<<LEFT_SHIFT)) >> RIGHT_SHIFT));
-		int blendG = (uint8_t) (GPixel_GetG(src) + (((TWO_FIVE_FIVE-src_a) * GPixel_GetG(dst) *  OPT_FACTOR + (1<<LEFT_SHIFT)) >> RIGHT_SHIFT));
-		int blendB = (uint8_t) (GPixel_GetB(src) + (((TWO_FIVE_FIVE-src_a) * GPixel_GetB(dst) *  OPT_FACTOR + (1<<LEFT_SHIFT)) >> RIGHT_SHIFT));
-		GPixel thePixel = GPixel_PackARGB(blendA, blendR, blendG, blendB);
-		return thePixel;
+		return blend_srcover(src, dst);
 }
 
 /* r,g,b values in GPixel need to be premultiplied*/
 void My_GCanvas::clear(const GColor& inputColor){
+	if(deferring){
+		// clear overwrites every pixel, whatever its alpha
+		deferred_draw& draw = record_draw(deferred_draw::kClear, GPaint());
+		draw.color = inputColor;
+		draw.bounds = GIRect::MakeLTRB(0, 0, bitmap.width(), bitmap.height());
+		draw.opaque = true;
+		return;
+	}
+	if(float_dst){
+		GColor c = inputColor.pinToUnit();
+		PixelF color = premul_to_float(c.fA, c.fR, c.fG, c.fB);
+		PixelF row[bitmap.width()];
+		for(int x = 0; x < bitmap.width(); ++x){
+			row[x] = color;
+		}
+		for(int y = 0; y < bitmap.height(); ++y){
+			float_dst->store_row(0, y, bitmap.width(), row);
+		}
+		return;
+	}
 	GPixel thePixel = premulPixel(inputColor);
-
-    for (int y = 0; y < bitmap.height(); ++y) {
-		GPixel* row = (GPixel*) (bitmap.fPixels + bitmap.fRowBytes *y/4);
-		for (int x = 0; x < bitmap.width(); ++x) {
-			*(row + x) = thePixel;
-        }
-    }
-	return;
+	for (int y = 0; y < bitmap.height(); ++y) {
+		blitter->fill_color(0, y, bitmap.width(), thePixel);
+	}
 }
 
 void My_GCanvas::drawRect(const GRect& new_rec, const GPaint& new_paint){
-	GPoint vertex[4];
+	drawRects(&new_rec,1,new_paint);
+}
+
+void My_GCanvas::drawRects(const GRect rects[], int count, const GPaint& paint){
+	if(deferring){
+		bool axis_aligned = my_CTM[GMatrix::KX] == 0 && my_CTM[GMatrix::KY] == 0;
+		bool opaque_color = paint.getShader() == nullptr && GPixel_GetA(premulPixel(paint.getColor())) == TWO_FIVE_FIVE;
+		for(int i = 0; i < count; ++i){
+			GIRect dst_rect;
+			if(axis_aligned && !device_rect(rects[i], dst_rect)){
+				continue;
+			}
+			deferred_draw& draw = record_draw(deferred_draw::kRect, paint);
+			draw.rect = rects[i];
+			if(axis_aligned){
+				draw.bounds = dst_rect;
+				draw.opaque = opaque_color;
+			}
+			else{
+				draw.bounds = map_bounds(rects[i]);
+			}
+		}
+		return;
+	}
+	if(my_CTM[GMatrix::KX] != 0 || my_CTM[GMatrix::KY] != 0){
+		// rotated or skewed: general polygon fill
+		for(int i = 0; i < count; ++i){
+			GPoint vertex[4];
+			vertex[0] = GPoint::Make(rects[i].left(),rects[i].top());
+			vertex[1] = GPoint::Make(rects[i].right(),rects[i].top());
+			vertex[2] = GPoint::Make(rects[i].right(),rects[i].bottom());
+			vertex[3] = GPoint::Make(rects[i].left(),rects[i].bottom());
+			//Vertex will be transform in the draw convex polygon
+			drawConvexPolygon(vertex,4,paint);
+		}
+		return;
+	}
+	// the paint is resolved once for the whole batch
+	GPixel color = 0;
+	if(paint.getShader() != nullptr){
+		paint.getShader()->setContext(my_CTM,1);
+	}
+	else{
+		color = premulPixel(paint.getColor());
+	}
+	GIRect dst_rect;
+	for(int i = 0; i < count; ++i){
+		if(device_rect(rects[i], dst_rect)){
+			fill_device_rect(dst_rect, paint, color);
+		}
+	}
+}
 
-	vertex[0] = GPoint::Make(new_rec.left(),new_rec.top());
-	vertex[1] = GPoint::Make(new_rec.right(),new_rec.top());
-	vertex[2] = GPoint::Make(new_rec.right(),new_rec.bottom());
-	vertex[3] = GPoint::Make(new_rec.left(),new_rec.bottom());
-	//Vertex will be transform in the draw convex polygon
-	drawConvexPolygon(vertex,4,new_paint);
-	return;
+// Under a scale/translate CTM a rect stays axis aligned and covers the pixels whose centers
+// fall inside it, the same rows and columns the polygon filler would pick.
+bool My_GCanvas::device_rect(const GRect& rect, GIRect& dst_rect){
+	float x0 = my_CTM[GMatrix::SX]*rect.left() + my_CTM[GMatrix::TX];
+	float x1 = my_CTM[GMatrix::SX]*rect.right() + my_CTM[GMatrix::TX];
+	float y0 = my_CTM[GMatrix::SY]*rect.top() + my_CTM[GMatrix::TY];
+	float y1 = my_CTM[GMatrix::SY]*rect.bottom() + my_CTM[GMatrix::TY];
+	dst_rect = GIRect::MakeLTRB(GRoundToInt(std::min(x0,x1)), GRoundToInt(std::min(y0,y1)),
+	                            GRoundToInt(std::max(x0,x1)), GRoundToInt(std::max(y0,y1)));
+	clip_rect(bitmap, dst_rect);
+	return !dst_rect.isEmpty();
+}
+
+// rect is in device space and already clipped; a shader's context must already be set
+void My_GCanvas::fill_device_rect(const GIRect& rect, const GPaint& paint, GPixel color){
+	for(int y = rect.top(); y < rect.bottom(); ++y){
+		if(paint.getShader() != nullptr){
+			shade_span(rect.left(),rect.right(),y,paint);
+		}
+		else if(float_dst){
+			scan_line_color_f(rect.left(),rect.right(),y,paint.getColor());
+		}
+		else{
+			blitter->blend_color(rect.left(),y,rect.width(),color);
+		}
+	}
 }
 
 bool My_GCanvas::check_invalid_pts (GPoint points[], int count){
@@ -223,7 +646,7 @@ bool My_GCanvas::check_invalid_pts (GPoint points[], int count){
 	//all on right?
 	invalid_num = 0;
 	for(int i = 0; i < count; ++i){
-		if(points[i].x()>bitmap.width()-1){
+		if(points[i].x()>=bitmap.width()-0.5f){
 			invalid_num++;
 		}
 	}
@@ -243,7 +666,7 @@ bool My_GCanvas::check_invalid_pts (GPoint points[], int count){
 	//over bound?
 	invalid_num = 0;
 	for(int i = 0; i < count; ++i){
-		if(points[i].y()>bitmap.width()-1){
+		if(points[i].y()>=bitmap.height()-0.5f){
 			invalid_num++;
 		}
 	}
@@ -255,6 +678,7 @@ bool My_GCanvas::check_invalid_pts (GPoint points[], int count){
 
 edge My_GCanvas::make_edge(GPoint a, GPoint b){
 	edge e;
+	e.curve_count = 0;
 	if (b.y()>a.y()){
 		 e.winding = 1;
 	}
@@ -280,6 +704,14 @@ edge My_GCanvas::make_edge(GPoint a, GPoint b){
 
 
 void My_GCanvas::drawConvexPolygon(const GPoint new_points[], int count, const GPaint& paint){
+	if(deferring){
+		if(count >= 2){
+			deferred_draw& draw = record_draw(deferred_draw::kPolygon, paint);
+			draw.pts.assign(new_points, new_points + count);
+			draw.bounds = deferred_bounds(new_points, count, 0);
+		}
+		return;
+	}
 	GPoint points[count];
 
 	if (count<2){
@@ -304,7 +736,7 @@ void My_GCanvas::drawConvexPolygon(const GPoint new_points[], int count, const G
 	edge left = edges[0];
 	edge right = edges[1];
 	int new_edge = 2;
-	while(new_edge<= count){
+	while(true){
 		int start = std::max(left.start_y,right.start_y);
 		int end = std::min(left.end_y,right.end_y);
 		for(int y = start; y< end; ++y){
@@ -317,6 +749,9 @@ void My_GCanvas::drawConvexPolygon(const GPoint new_points[], int count, const G
 			left.curr_x = left.curr_x + left.slope;
 			right.curr_x = right.curr_x + right.slope;
 		}
+		if(new_edge == count){
+			break;
+		}
 		if(left.end_y == end){
 			left = edges[new_edge];
 			new_edge++;
@@ -335,11 +770,193 @@ void My_GCanvas::drawConvexPolygon(const GPoint new_points[], int count, const G
 /************************************************PA5!!!!!!*************************************************************************/
 /************************************************PA5!!!!!!*************************************************************************/
 
-bool compare_y_end(const edge& a, const edge& b){
-	return a.end_y < b.end_y;
+// Records instead of drawing until endDeferred. Paints are copied, but their shaders are
+// only referenced and must live until the draws are flushed.
+void My_GCanvas::beginDeferred(){
+	deferring = true;
+}
+
+void My_GCanvas::endDeferred(){
+	flushDeferred();
+	deferring = false;
+}
+
+void My_GCanvas::flushDeferred(){
+	if(deferred.empty()){
+		return;
+	}
+	cull_deferred();
+	bool was_deferring = deferring;
+	deferring = false;
+	GMatrix ctm = my_CTM;
+	for(size_t i = 0; i < deferred.size(); ++i){
+		if(!deferred[i].culled){
+			my_CTM = deferred[i].ctm;
+			replay_deferred(deferred[i]);
+		}
+	}
+	my_CTM = ctm;
+	deferred.clear();
+	deferring = was_deferring;
+}
+
+deferred_draw& My_GCanvas::record_draw(deferred_draw::Kind kind, const GPaint& paint){
+	deferred.push_back(deferred_draw());
+	deferred_draw& draw = deferred.back();
+	draw.kind = kind;
+	draw.ctm = my_CTM;
+	draw.paint = paint;
+	draw.rule = FillRule::kWinding;
+	draw.bounds = GIRect::MakeLTRB(0, 0, 0, 0);
+	draw.opaque = false;
+	draw.culled = false;
+	return draw;
+}
+
+// device pixels a fill of pts may touch, their bounds grown by outset in local space
+GIRect My_GCanvas::deferred_bounds(const GPoint pts[], int count, float outset){
+	if(count < 1){
+		return GIRect::MakeLTRB(0, 0, 0, 0);
+	}
+	float l = pts[0].x(), t = pts[0].y(), r = l, b = t;
+	for(int i = 1; i < count; ++i){
+		l = std::min(l, pts[i].x());
+		r = std::max(r, pts[i].x());
+		t = std::min(t, pts[i].y());
+		b = std::max(b, pts[i].y());
+	}
+	return map_bounds(GRect::MakeLTRB(l - outset, t - outset, r + outset, b + outset));
+}
+
+// rect's mapped bounds rounded out, with a pixel to spare for rounding, clipped to the canvas
+GIRect My_GCanvas::map_bounds(const GRect& rect){
+	GPoint corners[4] = { GPoint::Make(rect.left(), rect.top()), GPoint::Make(rect.right(), rect.top()),
+	                      GPoint::Make(rect.right(), rect.bottom()), GPoint::Make(rect.left(), rect.bottom()) };
+	my_CTM.mapPoints(corners, corners, 4);
+	float l = corners[0].x(), t = corners[0].y(), r = l, b = t;
+	for(int i = 1; i < 4; ++i){
+		l = std::min(l, corners[i].x());
+		r = std::max(r, corners[i].x());
+		t = std::min(t, corners[i].y());
+		b = std::max(b, corners[i].y());
+	}
+	GIRect bounds = GIRect::MakeLTRB((int)floorf(l) - 1, (int)floorf(t) - 1, (int)ceilf(r) + 1, (int)ceilf(b) + 1);
+	clip_rect(bitmap, bounds);
+	return bounds;
+}
+
+// Walks the recording back to front. A draw is hidden when its bounds fit inside one of
+// the largest opaque rects drawn after it, or inside tiles such rects cover completely.
+void My_GCanvas::cull_deferred(){
+	int tiles_x = (bitmap.width() + OCCLUSION_TILE - 1) / OCCLUSION_TILE;
+	int tiles_y = (bitmap.height() + OCCLUSION_TILE - 1) / OCCLUSION_TILE;
+	std::vector<char> covered(tiles_x * tiles_y, 0);
+	std::vector<GIRect> occluders;
+	for(int i = (int)deferred.size() - 1; i >= 0; --i){
+		deferred_draw& draw = deferred[i];
+		const GIRect& b = draw.bounds;
+		if(b.isEmpty()){
+			draw.culled = true;
+			continue;
+		}
+		bool hidden = false;
+		for(size_t k = 0; k < occluders.size() && !hidden; ++k){
+			const GIRect& o = occluders[k];
+			hidden = o.left() <= b.left() && o.top() <= b.top() && o.right() >= b.right() && o.bottom() >= b.bottom();
+		}
+		if(!hidden){
+			hidden = true;
+			for(int ty = b.top() / OCCLUSION_TILE; ty <= (b.bottom() - 1) / OCCLUSION_TILE && hidden; ++ty){
+				for(int tx = b.left() / OCCLUSION_TILE; tx <= (b.right() - 1) / OCCLUSION_TILE && hidden; ++tx){
+					hidden = covered[ty * tiles_x + tx] != 0;
+				}
+			}
+		}
+		if(hidden){
+			draw.culled = true;
+			continue;
+		}
+		if(!draw.opaque){
+			continue;
+		}
+		// tiles entirely inside b, the last ones may be cut short by the canvas edge
+		int tx_end = b.right() == bitmap.width() ? tiles_x : b.right() / OCCLUSION_TILE;
+		int ty_end = b.bottom() == bitmap.height() ? tiles_y : b.bottom() / OCCLUSION_TILE;
+		for(int ty = (b.top() + OCCLUSION_TILE - 1) / OCCLUSION_TILE; ty < ty_end; ++ty){
+			for(int tx = (b.left() + OCCLUSION_TILE - 1) / OCCLUSION_TILE; tx < tx_end; ++tx){
+				covered[ty * tiles_x + tx] = 1;
+			}
+		}
+		if((int)occluders.size() < OCCLUSION_MAX_RECTS){
+			occluders.push_back(b);
+			continue;
+		}
+		size_t smallest = 0;
+		for(size_t k = 1; k < occluders.size(); ++k){
+			if((int64_t)occluders[k].width() * occluders[k].height() <
+			   (int64_t)occluders[smallest].width() * occluders[smallest].height()){
+				smallest = k;
+			}
+		}
+		if((int64_t)b.width() * b.height() > (int64_t)occluders[smallest].width() * occluders[smallest].height()){
+			occluders[smallest] = b;
+		}
+	}
+}
+
+void My_GCanvas::replay_deferred(const deferred_draw& draw){
+	switch(draw.kind){
+		case deferred_draw::kRect:
+			drawRects(&draw.rect, 1, draw.paint);
+			break;
+		case deferred_draw::kPolygon:
+			drawConvexPolygon(draw.pts.data(), (int)draw.pts.size(), draw.paint);
+			break;
+		case deferred_draw::kContours: {
+			std::vector<GContour> ctrs(draw.counts.size());
+			const GPoint* pts = draw.pts.data();
+			for(size_t i = 0; i < ctrs.size(); ++i){
+				ctrs[i].fCount = draw.counts[i];
+				ctrs[i].fPts = pts;
+				ctrs[i].fClosed = draw.closed[i] != 0;
+				pts += draw.counts[i];
+			}
+			drawContours(ctrs.data(), (int)ctrs.size(), draw.paint, draw.rule);
+			break;
+		}
+		case deferred_draw::kPath:
+			drawPath(draw.path, draw.paint);
+			break;
+		case deferred_draw::kClear:
+			clear(draw.color);
+			break;
+	}
 }
 
 void My_GCanvas::drawContours(const GContour ctrs[], int count, const GPaint& paint){
+	drawContours(ctrs, count, paint, FillRule::kWinding);
+}
+
+// the fill rule only applies to fills, strokes are always filled with nonzero winding
+void My_GCanvas::drawContours(const GContour ctrs[], int count, const GPaint& paint, FillRule rule){
+	if(deferring){
+		deferred_draw& draw = record_draw(deferred_draw::kContours, paint);
+		draw.rule = rule;
+		for(int i = 0; i < count; ++i){
+			draw.pts.insert(draw.pts.end(), ctrs[i].fPts, ctrs[i].fPts + ctrs[i].fCount);
+			draw.counts.push_back(ctrs[i].fCount);
+			draw.closed.push_back(ctrs[i].fClosed);
+		}
+		if(paint.getStrokeWidth() <= 0 && fill_rule_inside(0, rule)){
+			draw.bounds = GIRect::MakeLTRB(0, 0, bitmap.width(), bitmap.height());
+		}
+		else{
+			// miter joins reach at most miterLimit half widths out
+			float outset = paint.getStrokeWidth() > 0 ? paint.getStrokeWidth()/2*std::max(paint.getMiterLimit(), 1.0f) : 0;
+			draw.bounds = deferred_bounds(draw.pts.data(), (int)draw.pts.size(), outset);
+		}
+		return;
+	}
 	if(paint.getStrokeWidth()>0){
 		int ctr_num = 0;
 		for(int i = 0; i<count; ++i){
@@ -353,26 +970,17 @@ void My_GCanvas::drawContours(const GContour ctrs[], int count, const GPaint& pa
 		new_paint.setStrokeWidth(-1);
 		drawContours(dst_ctrs, dst_count, new_paint);
 	}
+	else if(edge_cache_limit > 0){
+		std::vector<edge>& total_edge = cached_edges(ctrs, count);
+		fill_sorted_edges(total_edge, (int)total_edge.size(), paint, rule);
+	}
 	else{
 		int total_edge_num = 0;
 		std::vector<edge> total_edge;
 		for (int i = 0; i < count;i++){
 			connect_contour(total_edge, ctrs[i], ctrs[i].fCount, total_edge_num);
 		}
-		if (total_edge_num <1){
-			return;
-		}
-		//sort all the edges in the total_edge
-		std::sort(total_edge.begin(), total_edge.end(),compare_y_end);
-		int y_end = GRoundToInt(total_edge[total_edge_num-1].end_y);
-		std::sort(total_edge.begin(), total_edge.end());
-		int y_start = GRoundToInt(total_edge[0].start_y);
-		std::list<edge> survivor;
-		int total_edge_idx = 0;
-		for(int curr_y = y_start; curr_y < y_end; ++curr_y){
-			check_survivor(survivor, total_edge,total_edge_num, curr_y, total_edge_idx);
-			color_survivor(survivor,curr_y,paint);
-		}
+		fill_edges(total_edge, total_edge_num, paint, rule);
 	}
 }
 
@@ -396,6 +1004,482 @@ void My_GCanvas::connect_contour(std::vector<edge> &total_edge, const GContour &
 	}
 }
 
+void My_GCanvas::setGeometryCache(int max_entries){
+	edge_cache_limit = std::max(0, max_entries);
+	while((int)edge_cache.size() > edge_cache_limit){
+		edge_cache.pop_back();
+	}
+}
+
+// FNV-1a
+static uint32_t hash_bytes(uint32_t hash, const void* data, size_t size){
+	const unsigned char* bytes = (const unsigned char*)data;
+	for(size_t k = 0; k < size; ++k){
+		hash = (hash ^ bytes[k]) * 16777619u;
+	}
+	return hash;
+}
+
+static uint32_t hash_contours(const GContour ctrs[], int count){
+	uint32_t hash = 2166136261u;
+	for(int i = 0; i < count; ++i){
+		hash = hash_bytes(hash, &ctrs[i].fCount, sizeof(int));
+		hash = hash_bytes(hash, ctrs[i].fPts, ctrs[i].fCount * sizeof(GPoint));
+	}
+	return hash;
+}
+
+static bool same_contours(const edge_cache_entry& entry, const GContour ctrs[], int count, uint32_t hash){
+	if(entry.hash != hash || (int)entry.src_counts.size() != count){
+		return false;
+	}
+	const GPoint* pts = entry.src_pts.data();
+	for(int i = 0; i < count; ++i){
+		if(entry.src_counts[i] != ctrs[i].fCount || memcmp(pts, ctrs[i].fPts, ctrs[i].fCount * sizeof(GPoint))){
+			return false;
+		}
+		pts += ctrs[i].fCount;
+	}
+	return true;
+}
+
+static bool compare_seg_top(const std::pair<float,int>& a, const std::pair<float,int>& b){
+	return a.first < b.first;
+}
+
+// rebuilds entry.edges from src_pts mapped by my_CTM. segs were sorted by top y under
+// entry.ctm; a translation keeps that order up to float rounding, which the insertion pass
+// repairs at the cost of one compare per edge when nothing moved.
+void My_GCanvas::build_cached_edges(edge_cache_entry& entry){
+	std::vector<GPoint> mapped_pts(entry.src_pts.size());
+	my_CTM.mapPoints(mapped_pts.data(), entry.src_pts.data(), (int)mapped_pts.size());
+	entry.edges.clear();
+	for(size_t i = 0; i < entry.segs.size(); i += 2){
+		const GPoint& a = mapped_pts[entry.segs[i]];
+		const GPoint& b = mapped_pts[entry.segs[i+1]];
+		if(GRoundToInt(a.y())!=GRoundToInt(b.y())){
+			entry.edges.push_back(make_edge(a,b));
+		}
+	}
+	for(size_t i = 1; i < entry.edges.size(); ++i){
+		for(size_t k = i; k > 0 && entry.edges[k].start_y < entry.edges[k-1].start_y; --k){
+			std::swap(entry.edges[k], entry.edges[k-1]);
+		}
+	}
+	entry.ctm = my_CTM;
+}
+
+// Sorted edge list for ctrs under my_CTM. A hit at the same translation reuses the edges
+// as they are, a hit that differs only in translation rebuilds them in the cached order.
+std::vector<edge>& My_GCanvas::cached_edges(const GContour ctrs[], int count){
+	uint32_t hash = hash_contours(ctrs, count);
+	for(std::list<edge_cache_entry>::iterator it = edge_cache.begin(); it != edge_cache.end(); ++it){
+		const GMatrix& m = (*it).ctm;
+		if(!same_contours(*it, ctrs, count, hash) ||
+		   m[GMatrix::SX] != my_CTM[GMatrix::SX] || m[GMatrix::KX] != my_CTM[GMatrix::KX] ||
+		   m[GMatrix::KY] != my_CTM[GMatrix::KY] || m[GMatrix::SY] != my_CTM[GMatrix::SY]){
+			continue;
+		}
+		edge_cache.splice(edge_cache.begin(), edge_cache, it);
+		edge_cache_entry& entry = edge_cache.front();
+		if(entry.ctm[GMatrix::TX] != my_CTM[GMatrix::TX] || entry.ctm[GMatrix::TY] != my_CTM[GMatrix::TY]){
+			build_cached_edges(entry);
+		}
+		return entry.edges;
+	}
+
+	edge_cache.push_front(edge_cache_entry());
+	edge_cache_entry& entry = edge_cache.front();
+	entry.hash = hash;
+	std::vector<std::pair<float,int> > tops;	// (top y, index of the edge's first point)
+	std::vector<int> next;
+	for(int i = 0; i < count; ++i){
+		int n = ctrs[i].fCount;
+		int first = (int)entry.src_pts.size();
+		entry.src_counts.push_back(n);
+		entry.src_pts.insert(entry.src_pts.end(), ctrs[i].fPts, ctrs[i].fPts + n);
+		GPoint mapped_pts[n];
+		my_CTM.mapPoints(mapped_pts, ctrs[i].fPts, n);
+		for(int k = 0; k < n; ++k){
+			tops.push_back(std::make_pair(std::min(mapped_pts[k].y(), mapped_pts[(k+1)%n].y()), first + k));
+			next.push_back(first + (k+1)%n);
+		}
+	}
+	std::stable_sort(tops.begin(), tops.end(), compare_seg_top);
+	for(size_t i = 0; i < tops.size(); ++i){
+		entry.segs.push_back(tops[i].second);
+		entry.segs.push_back(next[tops[i].second]);
+	}
+	build_cached_edges(entry);
+	if((int)edge_cache.size() > edge_cache_limit){
+		edge_cache.pop_back();
+	}
+	return entry.edges;
+}
+
+void My_GCanvas::setMaskCache(int max_entries){
+	mask_cache_limit = std::max(0, max_entries);
+	while((int)mask_cache.size() > mask_cache_limit){
+		mask_cache.pop_back();
+	}
+}
+
+// Coverage of path under my_CTM, and the whole pixel offset to blit it at. Returns
+// NULL for shapes the cache does not take: inverse fills and very large masks.
+const CoverageMask* My_GCanvas::cached_mask(const CurvePath& path, int& dx, int& dy){
+	FillRule rule = path.getFillRule();
+	if(fill_rule_inside(0, rule) || path.isEmpty()){
+		return NULL;
+	}
+	float tx = my_CTM[GMatrix::TX];
+	float ty = my_CTM[GMatrix::TY];
+	dx = (int)floorf(tx);
+	dy = (int)floorf(ty);
+	int sub_x = GRoundToInt((tx - dx) * MASK_SUBPIXEL_STEPS);
+	int sub_y = GRoundToInt((ty - dy) * MASK_SUBPIXEL_STEPS);
+	float linear[4] = { my_CTM[GMatrix::SX], my_CTM[GMatrix::KX], my_CTM[GMatrix::KY], my_CTM[GMatrix::SY] };
+	uint32_t hash = hash_bytes(2166136261u, path.points(), path.countPoints() * sizeof(GPoint));
+	hash = hash_bytes(hash, path.verbs(), path.countVerbs() * sizeof(CurvePath::Verb));
+
+	for(std::list<mask_cache_entry>::iterator it = mask_cache.begin(); it != mask_cache.end(); ++it){
+		const mask_cache_entry& entry = *it;
+		if(entry.hash == hash && entry.rule == rule && entry.sub_x == sub_x && entry.sub_y == sub_y &&
+		   !memcmp(entry.linear, linear, sizeof(linear)) &&
+		   (int)entry.src_pts.size() == path.countPoints() && (int)entry.src_verbs.size() == path.countVerbs() &&
+		   !memcmp(entry.src_pts.data(), path.points(), path.countPoints() * sizeof(GPoint)) &&
+		   !memcmp(entry.src_verbs.data(), path.verbs(), path.countVerbs() * sizeof(CurvePath::Verb))){
+			mask_cache.splice(mask_cache.begin(), mask_cache, it);
+			const CoverageMask& mask = mask_cache.front().mask;
+			dx += mask.fLeft;
+			dy += mask.fTop;
+			return &mask;
+		}
+	}
+
+	// the control point box bounds the curves, one extra pixel covers rounding
+	GMatrix m(linear[0], linear[1], (float)sub_x / MASK_SUBPIXEL_STEPS,
+	          linear[2], linear[3], (float)sub_y / MASK_SUBPIXEL_STEPS);
+	GRect r = path.bounds();
+	GPoint corners[4] = { GPoint::Make(r.left(), r.top()), GPoint::Make(r.right(), r.top()),
+	                      GPoint::Make(r.right(), r.bottom()), GPoint::Make(r.left(), r.bottom()) };
+	m.mapPoints(corners, corners, 4);
+	float l = corners[0].x(), t = corners[0].y(), rt = l, b = t;
+	for(int i = 1; i < 4; ++i){
+		l = std::min(l, corners[i].x());
+		rt = std::max(rt, corners[i].x());
+		t = std::min(t, corners[i].y());
+		b = std::max(b, corners[i].y());
+	}
+	int left = (int)floorf(l) - 1;
+	int top = (int)floorf(t) - 1;
+	int width = (int)ceilf(rt) + 1 - left;
+	int height = (int)ceilf(b) + 1 - top;
+	if(width > MASK_MAX_SIZE || height > MASK_MAX_SIZE){
+		return NULL;
+	}
+
+	mask_cache.push_front(mask_cache_entry());
+	mask_cache_entry& entry = mask_cache.front();
+	entry.hash = hash;
+	entry.rule = rule;
+	entry.sub_x = sub_x;
+	entry.sub_y = sub_y;
+	memcpy(entry.linear, linear, sizeof(linear));
+	entry.src_pts.assign(path.points(), path.points() + path.countPoints());
+	entry.src_verbs.assign(path.verbs(), path.verbs() + path.countVerbs());
+	CoverageMask& mask = entry.mask;
+	mask.fLeft = left;
+	mask.fTop = top;
+	mask.fWidth = width;
+	mask.fHeight = height;
+
+	// rasterize through a canvas the size of the mask that only records its spans
+	GBitmap bounds;
+	bounds.fWidth = width;
+	bounds.fHeight = height;
+	bounds.fRowBytes = width*4;
+	bounds.fPixels = NULL;
+	Mask_Recorder* recorder = new Mask_Recorder(&mask);
+	My_GCanvas mask_canvas(bounds, recorder);
+	GMatrix to_mask;
+	to_mask.setTranslate(-left, -top);
+	to_mask.preConcat(m);
+	mask_canvas.setCTM(to_mask);
+	GPaint mask_paint;
+	mask_paint.setStrokeWidth(-1);
+	mask_canvas.drawPath(path, mask_paint);
+	recorder->finish();
+
+	if((int)mask_cache.size() > mask_cache_limit){
+		mask_cache.pop_back();
+	}
+	dx += left;
+	dy += top;
+	return &mask;
+}
+
+// composites a mask whose first pixel lands on (dx,dy), clipped to the canvas
+void My_GCanvas::blit_mask(const CoverageMask& mask, int dx, int dy, const GPaint& paint){
+	if(paint.getShader() != nullptr){
+		paint.getShader()->setContext(my_CTM,1);
+	}
+	int y_start = std::max(0, -dy);
+	int y_end = std::min(mask.fHeight, bitmap.height() - dy);
+	for(int y = y_start; y < y_end; ++y){
+		row_runs.clear();
+		for(int i = mask.fRowStart[y]; i < mask.fRowStart[y+1]; i += 2){
+			add_run(mask.fRuns[i] + dx, mask.fRuns[i+1] + dx);
+		}
+		blit_runs(y + dy, paint);
+	}
+}
+
+// scan convert a device space edge list with the nonzero winding rule
+void My_GCanvas::fill_edges(std::vector<edge> &total_edge, int total_edge_num, const GPaint& paint, FillRule rule){
+	std::sort(total_edge.begin(), total_edge.end());
+	fill_sorted_edges(total_edge, total_edge_num, paint, rule);
+}
+
+// total_edge must already be ordered by start_y
+void My_GCanvas::fill_sorted_edges(std::vector<edge> &total_edge, int total_edge_num, const GPaint& paint, FillRule rule){
+	int y_start = 0;
+	int y_end = 0;
+	if(fill_rule_inside(0, rule)){
+		// inverse fills also cover the rows no edge reaches
+		y_end = bitmap.height();
+	}
+	else if(total_edge_num <1){
+		return;
+	}
+	else{
+		for(int i = 0; i < total_edge_num; ++i){
+			y_end = std::max(y_end, total_edge[i].end_y);
+		}
+		y_start = total_edge[0].start_y;
+	}
+	if(paint.getShader() != nullptr){
+		paint.getShader()->setContext(my_CTM,1);
+	}
+	std::list<edge> survivor;
+	int total_edge_idx = 0;
+	for(int curr_y = y_start; curr_y < y_end; ++curr_y){
+		check_survivor(survivor, total_edge,total_edge_num, curr_y, total_edge_idx);
+		color_survivor(survivor,curr_y,paint,rule);
+	}
+}
+
+void My_GCanvas::push_edge(std::vector<edge> &total_edge, GPoint a, GPoint b, int &total_edge_num){
+	if(GRoundToInt(a.y())!=GRoundToInt(b.y())){
+		total_edge.push_back(make_edge(a,b));
+		total_edge_num++;
+	}
+}
+
+// Curves are mapped by the CTM and become one stepping edge per y-monotonic piece,
+// so their chord count follows the device space size and never reaches the sort.
+void My_GCanvas::drawPath(const CurvePath& path, const GPaint& paint){
+	if(deferring){
+		deferred_draw& draw = record_draw(deferred_draw::kPath, paint);
+		draw.path = path;
+		if(paint.getStrokeWidth() <= 0 && fill_rule_inside(0, path.getFillRule())){
+			draw.bounds = GIRect::MakeLTRB(0, 0, bitmap.width(), bitmap.height());
+		}
+		else if(path.countVerbs() > 0){
+			GRect r = path.bounds();
+			float outset = paint.getStrokeWidth() > 0 ? paint.getStrokeWidth()/2*std::max(paint.getMiterLimit(), 1.0f) : 0;
+			draw.bounds = map_bounds(GRect::MakeLTRB(r.left() - outset, r.top() - outset, r.right() + outset, r.bottom() + outset));
+		}
+		return;
+	}
+	if(paint.getStrokeWidth()>0){
+		std::vector<std::vector<GPoint> > polys;
+		flatten_path(path, polys);
+		std::vector<GContour> ctrs;
+		for(size_t i = 0; i < polys.size(); ++i){
+			if(polys[i].size() > 1){
+				GContour ctr;
+				ctr.fCount = (int)polys[i].size();
+				ctr.fPts = polys[i].data();
+				ctr.fClosed = false;
+				ctrs.push_back(ctr);
+			}
+		}
+		if(!ctrs.empty()){
+			drawContours(ctrs.data(), (int)ctrs.size(), paint);
+		}
+		return;
+	}
+	if(mask_cache_limit > 0){
+		int dx, dy;
+		const CoverageMask* mask = cached_mask(path, dx, dy);
+		if(mask){
+			blit_mask(*mask, dx, dy, paint);
+			return;
+		}
+	}
+	std::vector<edge> total_edge;
+	int total_edge_num = 0;
+	const GPoint* pts = path.points();
+	const CurvePath::Verb* verbs = path.verbs();
+	GPoint start, last;
+	bool has_contour = false;
+	for(int i = 0; i < path.countVerbs(); ++i){
+		GPoint dev[4];
+		dev[0] = last;
+		switch(verbs[i]){
+			case CurvePath::Verb::kMove:
+				if(has_contour){
+					push_edge(total_edge, last, start, total_edge_num);
+				}
+				my_CTM.mapPoints(&start, pts, 1);
+				last = start;
+				has_contour = true;
+				break;
+			case CurvePath::Verb::kLine:
+				my_CTM.mapPoints(&dev[1], pts, 1);
+				push_edge(total_edge, last, dev[1], total_edge_num);
+				last = dev[1];
+				break;
+			case CurvePath::Verb::kQuad:
+				my_CTM.mapPoints(&dev[1], pts, 2);
+				push_curve_edge(total_edge, dev, 2, total_edge_num);
+				last = dev[2];
+				break;
+			case CurvePath::Verb::kCubic:
+				my_CTM.mapPoints(&dev[1], pts, 3);
+				push_curve_edge(total_edge, dev, 3, total_edge_num);
+				last = dev[3];
+				break;
+		}
+		pts += CurvePath::pts_per_verb(verbs[i]);
+	}
+	if(has_contour){
+		push_edge(total_edge, last, start, total_edge_num);
+	}
+	fill_edges(total_edge, total_edge_num, paint, path.getFillRule());
+}
+
+// Splits the device space curve into y-monotonic pieces and adds one edge for each.
+// The edge walks its chords by forward differencing as the scanline advances.
+void My_GCanvas::push_curve_edge(std::vector<edge> &total_edge, const GPoint pts[], int order, int &total_edge_num){
+	GPoint pieces[10];
+	int piece_count = order == 2 ? chop_quad_y_monotonic(pts, pieces) : chop_cubic_y_monotonic(pts, pieces);
+	for(int i = 0; i < piece_count; ++i){
+		GPoint p[4];
+		const GPoint* src = pieces + i*order;
+		edge e;
+		e.winding = src[order].y() > src[0].y() ? 1 : -1;
+		for(int k = 0; k <= order; ++k){
+			p[k] = e.winding > 0 ? src[k] : src[order-k];
+		}
+		e.start_y = std::min(std::max(GRoundToInt(p[0].y()),0), bitmap.height());
+		e.end_y = std::max(0, std::min(GRoundToInt(p[order].y()), bitmap.height()));
+		if(e.start_y >= e.end_y){
+			continue;
+		}
+		int n = order == 2 ? quad_segments(p) : cubic_segments(p);
+		float dt = 1.0f / n;
+		float dt2 = dt*dt;
+		if(order == 2){
+			float ax = p[0].fX - 2*p[1].fX + p[2].fX, ay = p[0].fY - 2*p[1].fY + p[2].fY;
+			float bx = 2*(p[1].fX - p[0].fX),          by = 2*(p[1].fY - p[0].fY);
+			e.d1x = ax*dt2 + bx*dt; e.d1y = ay*dt2 + by*dt;
+			e.d2x = 2*ax*dt2;       e.d2y = 2*ay*dt2;
+			e.d3x = 0;              e.d3y = 0;
+		}
+		else{
+			float dt3 = dt2*dt;
+			float ax = p[3].fX - 3*p[2].fX + 3*p[1].fX - p[0].fX;
+			float ay = p[3].fY - 3*p[2].fY + 3*p[1].fY - p[0].fY;
+			float bx = 3*(p[2].fX - 2*p[1].fX + p[0].fX), by = 3*(p[2].fY - 2*p[1].fY + p[0].fY);
+			float cx = 3*(p[1].fX - p[0].fX),               cy = 3*(p[1].fY - p[0].fY);
+			e.d1x = ax*dt3 + bx*dt2 + cx*dt; e.d1y = ay*dt3 + by*dt2 + cy*dt;
+			e.d2x = 6*ax*dt3 + 2*bx*dt2;     e.d2y = 6*ay*dt3 + 2*by*dt2;
+			e.d3x = 6*ax*dt3;                e.d3y = 6*ay*dt3;
+		}
+		e.curve_count = n;
+		e.seg_x = p[0].fX;
+		e.seg_y = p[0].fY;
+		e.seg_end_y = GRoundToInt(p[0].fY);
+		e.last_x = p[order].fX;
+		e.last_y = p[order].fY;
+		e.slope = 0;
+		e.curr_x = p[0].fX;
+		step_curve_edge(e, e.start_y);
+		total_edge.push_back(e);
+		total_edge_num++;
+	}
+}
+
+// Loads the chord of a curve edge that covers row y and sets curr_x at its center.
+void My_GCanvas::step_curve_edge(edge& e, int y){
+	float x0 = e.seg_x;
+	float y0 = e.seg_y;
+	bool advanced = false;
+	while(e.seg_end_y <= y && e.curve_count > 0){
+		x0 = e.seg_x;
+		y0 = e.seg_y;
+		if(e.curve_count == 1){
+			e.seg_x = e.last_x;
+			e.seg_y = e.last_y;
+		}
+		else{
+			e.seg_x += e.d1x;
+			e.seg_y += e.d1y;
+			e.d1x += e.d2x;
+			e.d1y += e.d2y;
+			e.d2x += e.d3x;
+			e.d2y += e.d3y;
+		}
+		e.curve_count--;
+		e.seg_end_y = GRoundToInt(e.seg_y);
+		advanced = true;
+	}
+	if(advanced){
+		float dy = e.seg_y - y0;
+		e.slope = dy != 0 ? (e.seg_x - x0)/dy : 0;
+		e.curr_x = x0 + e.slope*(y + 0.5 - y0);
+	}
+	else{
+		e.curr_x += e.slope;
+	}
+}
+
+// Local space polylines for the stroker, with segment counts still chosen from
+// the device space control points.
+void My_GCanvas::flatten_path(const CurvePath& path, std::vector<std::vector<GPoint> > &polys){
+	const GPoint* pts = path.points();
+	const CurvePath::Verb* verbs = path.verbs();
+	for(int i = 0; i < path.countVerbs(); ++i){
+		GPoint src[4];
+		GPoint dev[4];
+		std::vector<GPoint>* poly = polys.empty() ? nullptr : &polys.back();
+		switch(verbs[i]){
+			case CurvePath::Verb::kMove:
+				polys.push_back(std::vector<GPoint>(1, pts[0]));
+				break;
+			case CurvePath::Verb::kLine:
+				poly->push_back(pts[0]);
+				break;
+			case CurvePath::Verb::kQuad:
+				src[0] = poly->back(); src[1] = pts[0]; src[2] = pts[1];
+				my_CTM.mapPoints(dev, src, 3);
+				flatten_quad(src, quad_segments(dev), [&](GPoint, GPoint b){
+					poly->push_back(b);
+				});
+				break;
+			case CurvePath::Verb::kCubic:
+				src[0] = poly->back(); src[1] = pts[0]; src[2] = pts[1]; src[3] = pts[2];
+				my_CTM.mapPoints(dev, src, 4);
+				flatten_cubic(src, cubic_segments(dev), [&](GPoint, GPoint b){
+					poly->push_back(b);
+				});
+				break;
+		}
+		pts += CurvePath::pts_per_verb(verbs[i]);
+	}
+}
+
 bool compare_x(const edge& a,const edge& b){
 		return a.curr_x < b.curr_x;
 	}
@@ -418,30 +1502,71 @@ void My_GCanvas::check_survivor(std::list<edge> &survivor, std::vector<edge> &to
 	for(int i = total_edge_idx; i < total_edge_num; ++i){
 		assert(abs(total_edge[i].winding) <=1);
 		if (total_edge[i].start_y==curr_y){
-			survivor.push_back(total_edge[i]);
+			// edges clipped to zero height carry an unpaired winding into this row
+			if(total_edge[i].end_y > curr_y){
+				survivor.push_back(total_edge[i]);
+			}
 			total_edge_idx++;
 		}
 	}
 }
 
 
-void My_GCanvas::color_survivor(std::list<edge> &survivor, int curr_y,const GPaint& paint){
+// Appends a span to row_runs. Spans arrive sorted by their left edge, so one that
+// touches or overlaps the last run just extends it.
+void My_GCanvas::add_run(float x_left, float x_right){
+	int x_start = std::max(GRoundToInt(x_left),0);
+	int x_end = std::min(GRoundToInt(x_right),bitmap.width());
+	if(x_end <= x_start){
+		return;
+	}
+	if(!row_runs.empty() && x_start <= row_runs.back()){
+		row_runs.back() = std::max(row_runs.back(), x_end);
+		return;
+	}
+	row_runs.push_back(x_start);
+	row_runs.push_back(x_end);
+}
+
+// the shader's context is set once per fill by fill_sorted_edges
+void My_GCanvas::blit_runs(int curr_y, const GPaint& paint){
+	for(size_t i = 0; i < row_runs.size(); i += 2){
+		if(paint.getShader() == nullptr){
+			scan_line_shader_color(row_runs[i], row_runs[i+1], curr_y, paint.getColor());
+		}
+		else{
+			shade_span(row_runs[i], row_runs[i+1], curr_y, paint);
+		}
+	}
+}
+
+// Walks the row's edges left to right; the span after each edge is inside when the
+// rule says so for its winding count. Left of the first edge the count is 0, and
+// right of the last edge the span runs to the edge of the bitmap (inverse fills).
+// Inside spans are merged into runs before anything is shaded.
+void My_GCanvas::color_survivor(std::list<edge> &survivor, int curr_y,const GPaint& paint, FillRule rule){
 	int curr_winding = 0;
 	survivor.sort(compare_x);
 
+	row_runs.clear();
+	if(fill_rule_inside(0, rule)){
+		add_run(0, survivor.empty() ? bitmap.width() : survivor.front().curr_x);
+	}
 	for(std::list<edge>::iterator it = survivor.begin();it!= survivor.end();++it){
 		curr_winding += (*it).winding;
-		if (curr_winding != 0){
-			if(paint.getShader() == nullptr){
-				scan_line_shader_color((*it).curr_x, (*(std::next(it,1))).curr_x,curr_y,paint.getColor());
-			}
-			else{
-				scan_line_shader((*it).curr_x, (*(std::next(it,1))).curr_x,curr_y,paint);
-			}
+		if (fill_rule_inside(curr_winding, rule)){
+			std::list<edge>::iterator next = std::next(it,1);
+			add_run((*it).curr_x, next == survivor.end() ? bitmap.width() : (*next).curr_x);
 		}
 	}
+	blit_runs(curr_y, paint);
 	for(std::list<edge>::iterator it=survivor.begin(); it != survivor.end(); ++it){
-		(*it).curr_x += (*it).slope;
+		if((*it).curve_count > 0){
+			step_curve_edge(*it, curr_y+1);
+		}
+		else{
+			(*it).curr_x += (*it).slope;
+		}
 	}
 }
 
@@ -668,8 +1793,10 @@ void My_GCanvas::make_contour(GPoint a, GPoint b, GPoint c,GContour *dst_ctr ,fl
 /**********************************PA7**************************************************/
 void My_GCanvas::drawMesh(int triCount, const GPoint pts[], const int indices[],
  const GColor colors[], const GPoint tex[], const GPaint& paint){
+	immediate_scope immediate(this);
 	//construct ctrs
-	tri triangles[triCount];
+	mesh_tris.resize(triCount);
+	tri* triangles = mesh_tris.data();
 	if(indices){
 		for(int i = 0; i<triCount;++i){
 			triangles[i].vertices[0] = pts[indices[i*3]];
@@ -795,6 +1922,393 @@ void My_GCanvas::drawMesh(int triCount, const GPoint pts[], const int indices[],
 /**********************************PA7**************************************************/
 /**********************************PA7**************************************************/
 /**********************************PA7**************************************************/
+
+// corners are top-left, top-right, bottom-right, bottom-left. off_curve holds two
+// control points per edge in the order top, right, bottom, left, each edge running
+// left to right or top to bottom. A null off_curve gives straight edges.
+static void patch_edge_pts(const GPoint corners[4], const GPoint off_curve[8], int edge_idx, GPoint dst[4]){
+	static const int ends[4][2] = { {0, 1}, {1, 2}, {3, 2}, {0, 3} };
+	dst[0] = corners[ends[edge_idx][0]];
+	dst[3] = corners[ends[edge_idx][1]];
+	if(off_curve){
+		dst[1] = off_curve[edge_idx*2];
+		dst[2] = off_curve[edge_idx*2+1];
+	}
+	else{
+		dst[1] = curve_lerp(dst[0], dst[3], 1.0f/3);
+		dst[2] = curve_lerp(dst[0], dst[3], 2.0f/3);
+	}
+}
+
+// Enough rows/columns that the edges stay within a pixel of the true curves in
+// device space and bilinear color is not stretched over more than ~32 pixels.
+int My_GCanvas::patch_level(const GPoint corners[4], const GPoint off_curve[8]){
+	int level = 1;
+	float max_side = 0;
+	for(int i = 0; i < 4; ++i){
+		GPoint src[4];
+		GPoint dev[4];
+		patch_edge_pts(corners, off_curve, i, src);
+		my_CTM.mapPoints(dev, src, 4);
+		level = std::max(level, cubic_segments(dev, 1));
+		max_side = std::max(max_side, curve_len(dev[3].fX - dev[0].fX, dev[3].fY - dev[0].fY));
+	}
+	level = std::max(level, (int)ceilf(max_side/32));
+	return std::min(level, 64);
+}
+
+// Coons patch: S(u,v) = (1-v)top(u) + v*bottom(u) + (1-u)left(v) + u*right(v) - bilinear(corners)
+// level rows and columns, or patch_level's choice when it is 0
+void My_GCanvas::drawQuadPatch(const GPoint corners[4], const GPoint off_curve[8], const GColor colors[4],
+const GPoint tex[4], const GPaint& paint, int level){
+	immediate_scope immediate(this);
+	level = level > 0 ? std::min(level, 64) : patch_level(corners, off_curve);
+	const int stride = level + 1;
+	for(int i = 0; i < 4; ++i){
+		GPoint ctrl[4];
+		patch_edge_pts(corners, off_curve, i, ctrl);
+		std::vector<GPoint>& edge_pts = patch_edges[i];
+		edge_pts.clear();
+		edge_pts.push_back(ctrl[0]);
+		flatten_cubic(ctrl, level, [&](GPoint, GPoint b){
+			edge_pts.push_back(b);
+		});
+	}
+	const std::vector<GPoint>& top = patch_edges[0];
+	const std::vector<GPoint>& right = patch_edges[1];
+	const std::vector<GPoint>& bottom = patch_edges[2];
+	const std::vector<GPoint>& left = patch_edges[3];
+
+	patch_pts.resize(stride*stride);
+	patch_colors.resize(colors ? stride*stride : 0);
+	patch_tex.resize(tex ? stride*stride : 0);
+	const float dt = 1.0f / level;
+	for(int j = 0; j <= level; ++j){
+		float v = j*dt;
+		for(int i = 0; i <= level; ++i){
+			float u = i*dt;
+			float w0 = (1-u)*(1-v), w1 = u*(1-v), w2 = u*v, w3 = (1-u)*v;
+			GPoint& pt = patch_pts[j*stride + i];
+			pt.fX = (1-v)*top[i].fX + v*bottom[i].fX + (1-u)*left[j].fX + u*right[j].fX
+				- (w0*corners[0].fX + w1*corners[1].fX + w2*corners[2].fX + w3*corners[3].fX);
+			pt.fY = (1-v)*top[i].fY + v*bottom[i].fY + (1-u)*left[j].fY + u*right[j].fY
+				- (w0*corners[0].fY + w1*corners[1].fY + w2*corners[2].fY + w3*corners[3].fY);
+			if(colors){
+				GColor& c = patch_colors[j*stride + i];
+				c.fA = w0*colors[0].fA + w1*colors[1].fA + w2*colors[2].fA + w3*colors[3].fA;
+				c.fR = w0*colors[0].fR + w1*colors[1].fR + w2*colors[2].fR + w3*colors[3].fR;
+				c.fG = w0*colors[0].fG + w1*colors[1].fG + w2*colors[2].fG + w3*colors[3].fG;
+				c.fB = w0*colors[0].fB + w1*colors[1].fB + w2*colors[2].fB + w3*colors[3].fB;
+			}
+			if(tex){
+				GPoint& t = patch_tex[j*stride + i];
+				t.fX = w0*tex[0].fX + w1*tex[1].fX + w2*tex[2].fX + w3*tex[3].fX;
+				t.fY = w0*tex[0].fY + w1*tex[1].fY + w2*tex[2].fY + w3*tex[3].fY;
+			}
+		}
+	}
+
+	patch_indices.resize(level*level*6);
+	int* idx = patch_indices.data();
+	for(int j = 0; j < level; ++j){
+		for(int i = 0; i < level; ++i){
+			int k = j*stride + i;
+			*idx++ = k; *idx++ = k+1; *idx++ = k+stride+1;
+			*idx++ = k; *idx++ = k+stride+1; *idx++ = k+stride;
+		}
+	}
+	const int tri_count = level*level*2;
+	if(colors || tex){
+		drawMesh(tri_count, patch_pts.data(), patch_indices.data(),
+			colors ? patch_colors.data() : nullptr, tex ? patch_tex.data() : nullptr, paint);
+	}
+	else{
+		for(int i = 0; i < tri_count; ++i){
+			GPoint tri_pts[3] = { patch_pts[patch_indices[i*3]], patch_pts[patch_indices[i*3+1]],
+				patch_pts[patch_indices[i*3+2]] };
+			drawConvexPolygon(tri_pts, 3, paint);
+		}
+	}
+}
+
+// Sprite i is the src[i] rectangle of atlas with its top left corner at the origin of
+// xforms[i], optionally modulated by colors[i]. Every sprite is sampled straight from the
+// atlas (nearest texel) without building a shader or edges; a sprite that the CTM only
+// translates is blended as direct copies of atlas rows. The paint's alpha applies to the
+// whole batch and its shader is ignored. Sprites are drawn in order, later ones on top.
+void My_GCanvas::drawAtlas(const GBitmap& atlas, const GMatrix xforms[], const GIRect src[],
+		const GColor colors[], int count, const GPaint& paint){
+	immediate_scope immediate(this);
+	unsigned paint_alpha = unit_to_byte(paint.getAlpha());
+	if(paint_alpha == 0){
+		return;
+	}
+	if((int)row_buffer.size() < bitmap.width()){
+		row_buffer.resize(bitmap.width());
+	}
+	GPixel* row = row_buffer.data();
+	for(int i = 0; i < count; ++i){
+		GIRect r = GIRect::MakeLTRB(std::max(src[i].left(),0), std::max(src[i].top(),0),
+		                            std::min(src[i].right(),atlas.width()), std::min(src[i].bottom(),atlas.height()));
+		if(r.isEmpty()){
+			continue;
+		}
+		GPixel tint_pixel = colors ? premulPixel(colors[i]) : 0;
+		const GPixel* tint = colors ? &tint_pixel : nullptr;
+		GMatrix m;
+		m.setConcat(my_CTM, xforms[i]);
+		// the sprite covers pixels whose centers fall in [0,w)x[0,h) of sprite space
+		int w = r.width();
+		int h = r.height();
+
+		if(m[GMatrix::SX] == 1 && m[GMatrix::SY] == 1 && m[GMatrix::KX] == 0 && m[GMatrix::KY] == 0){
+			int x0 = (int)ceilf(m[GMatrix::TX] - 0.5f);
+			int y0 = (int)ceilf(m[GMatrix::TY] - 0.5f);
+			int x_start = std::max(x0, 0);
+			int x_end = std::min(x0 + w, bitmap.width());
+			int y_start = std::max(y0, 0);
+			int y_end = std::min(y0 + h, bitmap.height());
+			for(int y = y_start; y < y_end && x_start < x_end; ++y){
+				const GPixel* texels = atlas.getAddr(r.left() + x_start - x0, r.top() + y - y0);
+				if(!tint && paint_alpha == TWO_FIVE_FIVE){
+					blend_pixels(x_start, y, x_end - x_start, texels);
+				}
+				else{
+					memcpy(row, texels, (x_end - x_start) * sizeof(GPixel));
+					finish_sprite_row(x_start, y, x_end - x_start, row, tint, paint_alpha);
+				}
+			}
+			continue;
+		}
+
+		GMatrix inv;
+		if(!m.invert(&inv)){
+			continue;
+		}
+		GPoint corners[4] = { GPoint::Make(0,0), GPoint::Make(w,0), GPoint::Make(w,h), GPoint::Make(0,h) };
+		m.mapPoints(corners, corners, 4);
+		float top = corners[0].y(), bottom = top;
+		for(int k = 1; k < 4; ++k){
+			top = std::min(top, corners[k].y());
+			bottom = std::max(bottom, corners[k].y());
+		}
+		int y_start = std::max((int)ceilf(top - 0.5f), 0);
+		int y_end = std::min((int)ceilf(bottom - 0.5f), bitmap.height());
+		float du = inv[GMatrix::SX];
+		float dv = inv[GMatrix::KY];
+		for(int y = y_start; y < y_end; ++y){
+			// u(x) = du*x + u0 and v(x) = dv*x + v0 at pixel centers; keep the x where both are in range
+			float u0 = inv[GMatrix::KX]*(y + 0.5f) + inv[GMatrix::TX];
+			float v0 = inv[GMatrix::SY]*(y + 0.5f) + inv[GMatrix::TY];
+			float lo = -INFINITY, hi = INFINITY;
+			float coef[2] = { du, dv };
+			float base[2] = { u0, v0 };
+			float size[2] = { (float)w, (float)h };
+			for(int k = 0; k < 2; ++k){
+				if(coef[k] == 0){
+					if(base[k] < 0 || base[k] >= size[k]){
+						lo = INFINITY;
+					}
+					continue;
+				}
+				float a = -base[k] / coef[k];
+				float b = (size[k] - base[k]) / coef[k];
+				lo = std::max(lo, std::min(a, b));
+				hi = std::min(hi, std::max(a, b));
+			}
+			int x_start = (int)std::max(ceilf(lo - 0.5f), 0.0f);
+			int x_end = (int)std::min(ceilf(hi - 0.5f), (float)bitmap.width());
+			if(x_end <= x_start){
+				continue;
+			}
+			float u = du*(x_start + 0.5f) + u0;
+			float v = dv*(x_start + 0.5f) + v0;
+			for(int x = 0; x < x_end - x_start; ++x){
+				int tu = std::min(std::max((int)u, 0), w - 1);
+				int tv = std::min(std::max((int)v, 0), h - 1);
+				row[x] = *atlas.getAddr(r.left() + tu, r.top() + tv);
+				u += du;
+				v += dv;
+			}
+			finish_sprite_row(x_start, y, x_end - x_start, row, tint, paint_alpha);
+		}
+	}
+}
+
+// Splits [0,src_size) at divs into alternating fixed and stretchable segments, starting
+// with a fixed one, and lays them out over dst_size. Fixed segments keep their size and the
+// stretchable ones share what is left; when even the fixed ones do not fit they shrink
+// together. Writes count+2 boundaries into src_b and dst_b, false for bad divs.
+static bool lattice_bounds(const int divs[], int count, int src_size, float dst_start, float dst_size,
+		int src_b[], float dst_b[]){
+	src_b[0] = 0;
+	src_b[count+1] = src_size;
+	for(int i = 0; i < count; ++i){
+		src_b[i+1] = divs[i];
+		if(divs[i] < src_b[i] || divs[i] > src_size){
+			return false;
+		}
+	}
+	float fixed = 0, stretch = 0;
+	for(int k = 0; k <= count; ++k){
+		(k & 1 ? stretch : fixed) += src_b[k+1] - src_b[k];
+	}
+	float fixed_scale = 1, stretch_scale = 0;
+	if(dst_size < fixed || stretch == 0){
+		fixed_scale = fixed > 0 ? dst_size / fixed : 0;
+	}
+	else{
+		stretch_scale = (dst_size - fixed) / stretch;
+	}
+	dst_b[0] = dst_start;
+	for(int k = 0; k <= count; ++k){
+		dst_b[k+1] = dst_b[k] + (src_b[k+1] - src_b[k]) * (k & 1 ? stretch_scale : fixed_scale);
+	}
+	dst_b[count+1] = dst_start + dst_size;
+	return true;
+}
+
+// For device pixels [start,end), the source coordinate sampled at each pixel center.
+// Segments whose device size matches their source size map one to one.
+static void lattice_map(const int src_b[], const float dev_b[], int segs, int start, int end, int map[]){
+	int k = 0;
+	for(int c = start; c < end; ++c){
+		float center = c + 0.5f;
+		while(k < segs-1 && center >= dev_b[k+1]){
+			++k;
+		}
+		int src_w = src_b[k+1] - src_b[k];
+		float dev_w = dev_b[k+1] - dev_b[k];
+		int offset = dev_w > 0 ? (int)((center - dev_b[k]) * (src_w / dev_w)) : 0;
+		map[c - start] = src_b[k] + std::min(std::max(offset, 0), std::max(src_w - 1, 0));
+	}
+}
+
+// Draws src into dst, stretching only the odd segments between the x and y divs. With a
+// scale/translate CTM every device row is built from a column table in one pass: runs of
+// unscaled source pixels are copied straight from the source row and the rest are gathered.
+void My_GCanvas::drawBitmapLattice(const GBitmap& src, const int x_divs[], int x_count, const int y_divs[], int y_count,
+		const GRect& dst, const GPaint& paint){
+	immediate_scope immediate(this);
+	unsigned paint_alpha = unit_to_byte(paint.getAlpha());
+	if(src.width() <= 0 || src.height() <= 0 || dst.isEmpty() || paint_alpha == 0){
+		return;
+	}
+	int src_x[x_count+2];
+	int src_y[y_count+2];
+	float dst_x[x_count+2];
+	float dst_y[y_count+2];
+	if(!lattice_bounds(x_divs, x_count, src.width(), dst.left(), dst.width(), src_x, dst_x) ||
+	   !lattice_bounds(y_divs, y_count, src.height(), dst.top(), dst.height(), src_y, dst_y)){
+		return;
+	}
+	int x_segs = x_count + 1;
+	int y_segs = y_count + 1;
+
+	if(my_CTM[GMatrix::KX] != 0 || my_CTM[GMatrix::KY] != 0 || my_CTM[GMatrix::SX] <= 0 || my_CTM[GMatrix::SY] <= 0){
+		// rotated or flipped: one sprite per cell
+		std::vector<GMatrix> xforms;
+		std::vector<GIRect> rects;
+		for(int j = 0; j < y_segs; ++j){
+			for(int i = 0; i < x_segs; ++i){
+				GIRect r = GIRect::MakeLTRB(src_x[i], src_y[j], src_x[i+1], src_y[j+1]);
+				if(r.isEmpty() || dst_x[i+1] <= dst_x[i] || dst_y[j+1] <= dst_y[j]){
+					continue;
+				}
+				GMatrix m;
+				m.setTranslate(dst_x[i], dst_y[j]);
+				m.preScale((dst_x[i+1] - dst_x[i]) / r.width(), (dst_y[j+1] - dst_y[j]) / r.height());
+				xforms.push_back(m);
+				rects.push_back(r);
+			}
+		}
+		drawAtlas(src, xforms.data(), rects.data(), nullptr, (int)rects.size(), paint);
+		return;
+	}
+
+	for(int i = 0; i <= x_segs; ++i){
+		dst_x[i] = dst_x[i]*my_CTM[GMatrix::SX] + my_CTM[GMatrix::TX];
+	}
+	for(int j = 0; j <= y_segs; ++j){
+		dst_y[j] = dst_y[j]*my_CTM[GMatrix::SY] + my_CTM[GMatrix::TY];
+	}
+	int x_start = std::max((int)ceilf(dst_x[0] - 0.5f), 0);
+	int x_end = std::min((int)ceilf(dst_x[x_segs] - 0.5f), bitmap.width());
+	int y_start = std::max((int)ceilf(dst_y[0] - 0.5f), 0);
+	int y_end = std::min((int)ceilf(dst_y[y_segs] - 0.5f), bitmap.height());
+	if(x_end <= x_start || y_end <= y_start){
+		return;
+	}
+	int count = x_end - x_start;
+	int x_map[count];
+	int y_map[y_end - y_start];
+	lattice_map(src_x, dst_x, x_segs, x_start, x_end, x_map);
+	lattice_map(src_y, dst_y, y_segs, y_start, y_end, y_map);
+
+	if((int)row_buffer.size() < bitmap.width()){
+		row_buffer.resize(bitmap.width());
+	}
+	GPixel* row = row_buffer.data();
+	for(int y = y_start; y < y_end; ++y){
+		const GPixel* src_row = src.getAddr(0, y_map[y - y_start]);
+		int i = 0;
+		while(i < count){
+			// extend the run while the source advances one pixel per device pixel
+			int run = 1;
+			while(i + run < count && x_map[i + run] == x_map[i] + run){
+				++run;
+			}
+			if(run > 1){
+				memcpy(row + i, src_row + x_map[i], run * sizeof(GPixel));
+			}
+			else{
+				row[i] = src_row[x_map[i]];
+			}
+			i += run;
+		}
+		if(paint_alpha != TWO_FIVE_FIVE){
+			scale_row(row, count, paint_alpha);
+		}
+		blend_pixels(x_start, y, count, row);
+	}
+}
+
+// nine patch: center is the stretchable part of src, the corners keep their size
+void My_GCanvas::drawBitmapNine(const GBitmap& src, const GIRect& center, const GRect& dst, const GPaint& paint){
+	immediate_scope immediate(this);
+	int x_divs[2] = { center.left(), center.right() };
+	int y_divs[2] = { center.top(), center.bottom() };
+	drawBitmapLattice(src, x_divs, 2, y_divs, 2, dst, paint);
+}
+
+void My_GCanvas::finish_sprite_row(int x, int y, int count, GPixel row[], const GPixel* tint, unsigned alpha){
+	if(tint){
+		for(int i = 0; i < count; ++i){
+			row[i] = mul_pixels(row[i], *tint);
+		}
+	}
+	if(alpha != TWO_FIVE_FIVE){
+		scale_row(row, count, alpha);
+	}
+	blend_pixels(x, y, count, row);
+}
+
+// src-over a row of premultiplied pixels onto whichever destination the canvas has
+void My_GCanvas::blend_pixels(int x, int y, int count, const GPixel row[]){
+	if(float_dst){
+		PixelF src[count];
+		PixelF dst[count];
+		for(int i = 0; i < count; ++i){
+			src[i] = pixel_to_float(row[i]);
+		}
+		float_dst->load_row(x,y,count,dst);
+		blend_srcover_row_f(dst,src,count);
+		float_dst->store_row(x,y,count,dst);
+		return;
+	}
+	blitter->blend_row(x,y,count,row);
+}
+
 void My_GCanvas::scan_line_shader(float x_left, float x_right,int curr_y, const GPaint& paint){
 	// pay attention to the center error
 	int x_int_left = GRoundToInt(x_left);
@@ -804,17 +2318,32 @@ void My_GCanvas::scan_line_shader(float x_left, float x_right,int curr_y, const
 	int x_end = std::max(x_int_left,x_int_right);
 	x_end = std::min(x_end,bitmap.width());
 
+	paint.getShader()->setContext(my_CTM,1);
+	shade_span(x_start,x_end,curr_y,paint);
+}
+
+// shades and blends [x_start, x_end) of curr_y; the shader's context must already be set
+void My_GCanvas::shade_span(int x_start, int x_end, int curr_y, const GPaint& paint){
 	int pixel_num = x_end - x_start;
+	if(pixel_num <= 0){
+		return;
+	}
+	if(float_dst){
+		scan_line_shader_f(x_start,x_end,curr_y,paint);
+		return;
+	}
 
-	GPixel row[bitmap.width()];
-	paint.getShader()->setContext(my_CTM,paint.getAlpha());
+	if((int)row_buffer.size() < pixel_num){
+		row_buffer.resize(bitmap.width());
+	}
+	GPixel* row = row_buffer.data();
 	paint.getShader()->shadeRow(x_start,curr_y,pixel_num,row);
-	int i = 0;
-	for(int x = x_start; x < x_end; ++x){
-		GPixel *dst = bitmap.getAddr(x,curr_y);
-		*dst = blend_src_dst(row[i],*dst);
-		i++;
+	// shaders emit unmodulated pixels, paint alpha is applied once per row here
+	unsigned paint_alpha = unit_to_byte(paint.getAlpha());
+	if(paint_alpha != TWO_FIVE_FIVE){
+		scale_row(row,pixel_num,paint_alpha);
 	}
+	blitter->blend_row(x_start,curr_y,pixel_num,row);
 }
 
 void My_GCanvas::scan_line_shader_color(float x_left, float x_right,int curr_y, const GColor& src_color){
@@ -824,15 +2353,40 @@ void My_GCanvas::scan_line_shader_color(float x_left, float x_right,int curr_y,
 	x_start = std::max(x_start,0);
 	int x_end = std::max(x_int_left,x_int_right);
 	x_end = std::min(x_end,bitmap.width());
+	if(x_end <= x_start){
+		return;
+	}
+	if(float_dst){
+		scan_line_color_f(x_start,x_end,curr_y,src_color);
+		return;
+	}
 	GPixel src_pixel = premulPixel(src_color);
-	for(int x = x_start; x < x_end; x++){
-		GPixel *dst = bitmap.getAddr(x,curr_y);
-		if(src_color.fA==1){
-			*dst = src_pixel;
-		}
-		else{
-			*dst = blend_src_dst(src_pixel, * dst);
-		}
+	blitter->blend_color(x_start,curr_y,x_end-x_start,src_pixel);
+}
+
+void My_GCanvas::scan_line_shader_f(int x_start, int x_end, int curr_y, const GPaint& paint){
+	int pixel_num = x_end - x_start;
+	if(pixel_num <= 0){
+		return;
+	}
+	PixelF row[pixel_num];
+	PixelF dst[pixel_num];
+	shade_row_f(paint.getShader(),x_start,curr_y,pixel_num,row);
+	float paint_alpha = GPinToUnit(paint.getAlpha());
+	if(paint_alpha < 1){
+		scale_row_f(row,pixel_num,paint_alpha);
 	}
+	float_dst->load_row(x_start,curr_y,pixel_num,dst);
+	blend_srcover_row_f(dst,row,pixel_num);
+	float_dst->store_row(x_start,curr_y,pixel_num,dst);
 }
 
+void My_GCanvas::scan_line_color_f(int x_start, int x_end, int curr_y, const GColor& src_color){
+	int pixel_num = x_end - x_start;
+	GColor c = src_color.pinToUnit();
+	PixelF src = premul_to_float(c.fA, c.fR, c.fG, c.fB);
+	PixelF dst[pixel_num];
+	float_dst->load_row(x_start,curr_y,pixel_num,dst);
+	blend_srcover_color_row_f(dst,src,pixel_num);
+	float_dst->store_row(x_start,curr_y,pixel_num,dst);
+}
\ No newline at end of file
@@ -0,0 +1,90 @@
+#ifndef Owned_Bitmap_DEFINED
+#define Owned_Bitmap_DEFINED
+
+#include "GBitmap.h"
+#include "Pixel_Pool.h"
+
+// Owns the pixels of the GBitmap it hands out. Every row starts on a PIXEL_ALIGN boundary,
+// fRowBytes being padded to a multiple of it, so row kernels can use aligned vector loads.
+// With a pool the pixels are recycled through it instead of going back to the system
+// allocator. The GBitmap is a member, not a base: GBitmap has no virtual destructor, so an
+// owner must never be deletable through a GBitmap pointer.
+class OwnedBitmap {
+public:
+    OwnedBitmap(PixelPool* pool = nullptr) : fPool(pool), fCount(0){
+        fBitmap.fWidth = 0;
+        fBitmap.fHeight = 0;
+        fBitmap.fRowBytes = 0;
+        fBitmap.fPixels = NULL;
+    }
+
+    OwnedBitmap(int width, int height, PixelPool* pool = nullptr) : OwnedBitmap(pool){
+        this->allocate(width, height);
+    }
+
+    ~OwnedBitmap(){
+        this->release();
+    }
+
+    // valid until the next allocate() or release()
+    const GBitmap& bitmap() const { return fBitmap; }
+
+    static size_t aligned_row_bytes(int width){
+        return ((size_t)width * sizeof(GPixel) + PIXEL_ALIGN - 1) & ~(size_t)(PIXEL_ALIGN - 1);
+    }
+
+    // transparent pixels for width x height, false (and empty) on bad sizes or no memory
+    bool allocate(int width, int height){
+        this->release();
+        if(width <= 0 || height <= 0){
+            return false;
+        }
+        size_t row_bytes = aligned_row_bytes(width);
+        size_t count = row_bytes / sizeof(GPixel) * height;
+        GPixel* pixels;
+        if(fPool){
+            pixels = fPool->acquire(count);
+        }
+        else{
+            pixels = alloc_aligned_pixels(count);
+            if(pixels){
+                memset(pixels, 0, count * sizeof(GPixel));
+            }
+        }
+        if(!pixels){
+            return false;
+        }
+        fBitmap.fWidth = width;
+        fBitmap.fHeight = height;
+        fBitmap.fRowBytes = row_bytes;
+        fBitmap.fPixels = pixels;
+        fCount = count;
+        return true;
+    }
+
+    void release(){
+        if(fBitmap.fPixels){
+            if(fPool){
+                fPool->release(fBitmap.fPixels, fCount);
+            }
+            else{
+                free(fBitmap.fPixels);
+            }
+        }
+        fBitmap.fWidth = 0;
+        fBitmap.fHeight = 0;
+        fBitmap.fRowBytes = 0;
+        fBitmap.fPixels = NULL;
+        fCount = 0;
+    }
+
+private:
+    OwnedBitmap(const OwnedBitmap&);
+    OwnedBitmap& operator=(const OwnedBitmap&);
+
+    GBitmap    fBitmap;
+    PixelPool* fPool;
+    size_t     fCount;
+};
+
+#endif
@@ -0,0 +1,67 @@
+#ifndef Pixel_Formats_DEFINED
+#define Pixel_Formats_DEFINED
+
+#include "GCanvas.h"
+#include "GPixel.h"
+#include "Pixel_Math.h"
+#include <stddef.h>
+#include <stdint.h>
+
+// Destination formats beyond the native premultiplied GPixel.
+enum class PixelFormat {
+    kARGB_8888,     // GPixel
+    kBGRA_8888,     // GPixel with red and blue swapped
+    kRGB_565,       // opaque, r in the high 5 bits
+    kA8,            // alpha/coverage only
+    kSRGB_8888,     // GPixel layout holding sRGB encoded colors, blended in linear light
+};
+
+static inline int bytes_per_pixel(PixelFormat format){
+    switch (format){
+        case PixelFormat::kARGB_8888:
+        case PixelFormat::kBGRA_8888:
+        case PixelFormat::kSRGB_8888:
+            return 4;
+        case PixelFormat::kRGB_565:
+            return 2;
+        case PixelFormat::kA8:
+            return 1;
+    }
+    return 0;
+}
+
+static inline GPixel expand_565(uint16_t c){
+    unsigned r = (c >> 11) & 0x1F;
+    unsigned g = (c >> 5) & 0x3F;
+    unsigned b = c & 0x1F;
+    return GPixel_PackARGB(0xFF, (r << 3) | (r >> 2), (g << 2) | (g >> 4), (b << 3) | (b >> 2));
+}
+
+static inline uint16_t pack_565(GPixel pix){
+    unsigned r = div255(GPixel_GetR(pix) * 31);
+    unsigned g = div255(GPixel_GetG(pix) * 63);
+    unsigned b = div255(GPixel_GetB(pix) * 31);
+    return (uint16_t)((r << 11) | (g << 5) | b);
+}
+
+// GBitmap with untyped pixels; the caller owns fPixels.
+struct FormatBitmap {
+    int         fWidth;
+    int         fHeight;
+    size_t      fRowBytes;
+    void*       fPixels;
+    PixelFormat fFormat;
+
+    int width() const { return fWidth; }
+    int height() const { return fHeight; }
+    size_t rowBytes() const { return fRowBytes; }
+
+    void* getAddr(int x, int y) const{
+        return (char*)fPixels + y * fRowBytes + x * bytes_per_pixel(fFormat);
+    }
+};
+
+// canvas whose span blitter is specialized for dst's format, NULL on bad input
+GCanvas* create_format_canvas(const FormatBitmap& dst);
+
+#endif
@@ -0,0 +1,139 @@
+#ifndef Pixel_Math_DEFINED
+#define Pixel_Math_DEFINED
+
+#include "GPixel.h"
+#include "GMath.h"
+#include <stdint.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// Correctly rounded 8-bit premultiplied helpers shared by the canvas and every shader.
+// div255(x) == round(x/255) for every x in [0, 255*255].
+
+static inline unsigned div255(unsigned x){
+    return ((x + 128) * 257) >> 16;
+}
+
+static inline unsigned mul_div255(unsigned a, unsigned b){
+    return div255(a * b);
+}
+
+// t in [0,255]: t == 255 gives a, t == 0 gives b
+static inline unsigned lerp255(unsigned a, unsigned b, unsigned t){
+    return div255(a * t + b * (255 - t));
+}
+
+static inline unsigned unit_to_byte(float x){
+    return GRoundToInt(GPinToUnit(x) * 255);
+}
+
+// scale all four channels of a premultiplied pixel by s/255, two channels per multiply
+static inline GPixel scale_pixel(GPixel pix, unsigned s){
+    uint32_t rb = (pix & 0x00FF00FF) * s + 0x00800080;
+    uint32_t ag = ((pix >> 8) & 0x00FF00FF) * s + 0x00800080;
+    rb = ((rb + ((rb >> 8) & 0x00FF00FF)) >> 8) & 0x00FF00FF;
+    ag = (ag + ((ag >> 8) & 0x00FF00FF)) & 0xFF00FF00;
+    return rb | ag;
+}
+
+// src-over: src + dst*(1 - src_a)
+static inline GPixel blend_srcover(GPixel src, GPixel dst){
+    return src + scale_pixel(dst, 255 - GPixel_GetA(src));
+}
+
+static inline GPixel mul_pixels(GPixel a, GPixel b){
+    return GPixel_PackARGB(mul_div255(GPixel_GetA(a), GPixel_GetA(b)),
+                           mul_div255(GPixel_GetR(a), GPixel_GetR(b)),
+                           mul_div255(GPixel_GetG(a), GPixel_GetG(b)),
+                           mul_div255(GPixel_GetB(a), GPixel_GetB(b)));
+}
+
+#ifdef __SSE2__
+// 16-bit lanes: round(x/255) for x in [0, 255*255]
+static inline __m128i div255_epu16(__m128i x){
+    return _mm_mulhi_epu16(_mm_add_epi16(x, _mm_set1_epi16(128)), _mm_set1_epi16(257));
+}
+
+// per lane: broadcast each pixel's alpha byte into its four 16-bit channels, returns 255 - a
+static inline __m128i inv_alpha_epu16(__m128i px16){
+    __m128i a = _mm_shufflelo_epi16(px16, _MM_SHUFFLE(3, 3, 3, 3));
+    a = _mm_shufflehi_epi16(a, _MM_SHUFFLE(3, 3, 3, 3));
+    return _mm_sub_epi16(_mm_set1_epi16(255), a);
+}
+
+static inline __m128i srcover_4(__m128i src, __m128i dst){
+    __m128i zero = _mm_setzero_si128();
+    __m128i s_lo = _mm_unpacklo_epi8(src, zero);
+    __m128i s_hi = _mm_unpackhi_epi8(src, zero);
+    __m128i d_lo = _mm_unpacklo_epi8(dst, zero);
+    __m128i d_hi = _mm_unpackhi_epi8(dst, zero);
+    d_lo = div255_epu16(_mm_mullo_epi16(d_lo, inv_alpha_epu16(s_lo)));
+    d_hi = div255_epu16(_mm_mullo_epi16(d_hi, inv_alpha_epu16(s_hi)));
+    return _mm_add_epi8(src, _mm_packus_epi16(d_lo, d_hi));
+}
+
+static inline __m128i scale_4(__m128i px, __m128i s16){
+    __m128i zero = _mm_setzero_si128();
+    __m128i lo = div255_epu16(_mm_mullo_epi16(_mm_unpacklo_epi8(px, zero), s16));
+    __m128i hi = div255_epu16(_mm_mullo_epi16(_mm_unpackhi_epi8(px, zero), s16));
+    return _mm_packus_epi16(lo, hi);
+}
+#endif
+
+// dst[i] = src[i] over dst[i]
+static inline void blend_srcover_row(GPixel dst[], const GPixel src[], int count){
+    int i = 0;
+#ifdef __SSE2__
+    for(; i + 4 <= count; i += 4){
+        __m128i s = _mm_loadu_si128((const __m128i*)(src + i));
+        __m128i d = _mm_loadu_si128((const __m128i*)(dst + i));
+        _mm_storeu_si128((__m128i*)(dst + i), srcover_4(s, d));
+    }
+#endif
+    for(; i < count; ++i){
+        dst[i] = blend_srcover(src[i], dst[i]);
+    }
+}
+
+// dst[i] = src over dst[i], with a single constant src
+static inline void blend_srcover_color_row(GPixel dst[], GPixel src, int count){
+    unsigned src_a = GPixel_GetA(src);
+    if(src_a == 255){
+        for(int i = 0; i < count; ++i){
+            dst[i] = src;
+        }
+        return;
+    }
+    if(src_a == 0 && src == 0){
+        return;
+    }
+    int i = 0;
+#ifdef __SSE2__
+    __m128i s = _mm_set1_epi32((int)src);
+    for(; i + 4 <= count; i += 4){
+        __m128i d = _mm_loadu_si128((const __m128i*)(dst + i));
+        _mm_storeu_si128((__m128i*)(dst + i), srcover_4(s, d));
+    }
+#endif
+    for(; i < count; ++i){
+        dst[i] = blend_srcover(src, dst[i]);
+    }
+}
+
+// row[i] *= s/255
+static inline void scale_row(GPixel row[], int count, unsigned s){
+    int i = 0;
+#ifdef __SSE2__
+    __m128i s16 = _mm_set1_epi16((short)s);
+    for(; i + 4 <= count; i += 4){
+        __m128i p = _mm_loadu_si128((const __m128i*)(row + i));
+        _mm_storeu_si128((__m128i*)(row + i), scale_4(p, s16));
+    }
+#endif
+    for(; i < count; ++i){
+        row[i] = scale_pixel(row[i], s);
+    }
+}
+
+#endif
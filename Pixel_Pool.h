@@ -0,0 +1,96 @@
+#ifndef Pixel_Pool_DEFINED
+#define Pixel_Pool_DEFINED
+
+#include "GPixel.h"
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#define PIXEL_POOL_MIN_CLASS 6      // 64 pixels
+#define PIXEL_POOL_CLASSES   32
+#define PIXEL_POOL_KEEP      4      // free buffers kept per size class
+#define PIXEL_ALIGN          64     // byte alignment of every buffer, one cache line
+
+// PIXEL_ALIGN aligned, release with free()
+static inline GPixel* alloc_aligned_pixels(size_t count){
+    void* pixels = NULL;
+    if(posix_memalign(&pixels, PIXEL_ALIGN, count * sizeof(GPixel))){
+        return NULL;
+    }
+    return (GPixel*)pixels;
+}
+
+// Recycles pixel buffers in power of two size classes, so offscreens that come and go
+// every frame reuse the same few allocations instead of going to the heap. Not thread
+// safe; give each thread its own pool.
+class PixelPool {
+public:
+    ~PixelPool(){
+        for(int k = 0; k < PIXEL_POOL_CLASSES; ++k){
+            for(size_t i = 0; i < fFree[k].size(); ++i){
+                free(fFree[k][i]);
+            }
+        }
+    }
+
+    // zeroed buffer of at least count pixels, NULL when count is too large
+    GPixel* acquire(size_t count){
+        int k = size_class(count);
+        if(k < 0){
+            return NULL;
+        }
+        GPixel* pixels;
+        if(!fFree[k].empty()){
+            pixels = fFree[k].back();
+            fFree[k].pop_back();
+        }
+        else{
+            pixels = alloc_aligned_pixels((size_t)1 << k);
+            if(!pixels){
+                return NULL;
+            }
+        }
+        memset(pixels, 0, count * sizeof(GPixel));
+        return pixels;
+    }
+
+    // count must be the value pixels was acquired with
+    void release(GPixel* pixels, size_t count){
+        int k = size_class(count);
+        if(!pixels || k < 0){
+            return;
+        }
+        if(fFree[k].size() < PIXEL_POOL_KEEP){
+            fFree[k].push_back(pixels);
+        }
+        else{
+            free(pixels);
+        }
+    }
+
+    // free buffers kept for the size class of count
+    size_t kept(size_t count) const{
+        int k = size_class(count);
+        return k < 0 ? 0 : fFree[k].size();
+    }
+
+private:
+    static int size_class(size_t count){
+        int k = PIXEL_POOL_MIN_CLASS;
+        while(k < PIXEL_POOL_CLASSES && ((size_t)1 << k) < count){
+            ++k;
+        }
+        return k < PIXEL_POOL_CLASSES ? k : -1;
+    }
+
+    std::vector<GPixel*> fFree[PIXEL_POOL_CLASSES];
+};
+
+// pool for bitmaps that do not name one; inline, not static, so every translation unit
+// shares the one pool
+inline PixelPool& shared_pixel_pool(){
+    static PixelPool pool;
+    return pool;
+}
+
+#endif
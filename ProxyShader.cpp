@@ -7,11 +7,12 @@
 #include "GPoint.h"
 #include "GMatrix.h"
 #include "GShader.h"
+#include "Float_Pipeline.h"
 #include <stdio.h>
 #include <cstdint>
 
 
-class ProxyShader: public GShader{
+class ProxyShader: public GShader, public FloatShader{
     public:
     GShader* fshader;
     const GMatrix fmatrix;
@@ -29,4 +30,8 @@ class ProxyShader: public GShader{
     void shadeRow(int x, int y, int count, GPixel row[]){
         fshader->shadeRow(x,y,count,row);
     }
+
+    void shadeRowF(int x, int y, int count, PixelF row[]){
+        shade_row_f(fshader,x,y,count,row);
+    }
 };
\ No newline at end of file
@@ -0,0 +1,135 @@
+#ifndef SRGB_Tables_DEFINED
+#define SRGB_Tables_DEFINED
+
+#include "GPixel.h"
+#include "GColor.h"
+#include "GShader.h"
+#include "Pixel_Math.h"
+#include <math.h>
+#include <stdint.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// Table driven sRGB <-> linear conversions for gamma correct blending.
+
+#define SRGB_ENCODE_BITS 12
+#define SRGB_ENCODE_SIZE (1 << SRGB_ENCODE_BITS)
+
+static inline float srgb_to_linear_exact(float c){
+    return c <= 0.04045f ? c / 12.92f : powf((c + 0.055f) / 1.055f, 2.4f);
+}
+
+static inline float linear_to_srgb_exact(float c){
+    return c <= 0.0031308f ? c * 12.92f : 1.055f * powf(c, 1 / 2.4f) - 0.055f;
+}
+
+struct SRGB_Tables {
+    float    to_linear[256];                // encoded byte -> linear [0,1]
+    uint8_t  to_srgb[SRGB_ENCODE_SIZE];     // linear quantized to 12 bits -> encoded byte
+    uint32_t unpremul[256];                 // 16.16 reciprocal: c * unpremul[a] >> 16 == c*255/a
+
+    SRGB_Tables(){
+        for(int i = 0; i < 256; ++i){
+            to_linear[i] = srgb_to_linear_exact(i / 255.0f);
+            unpremul[i] = i ? ((255 << 16) + i/2) / i : 0;
+        }
+        for(int i = 0; i < SRGB_ENCODE_SIZE; ++i){
+            to_srgb[i] = (uint8_t)GRoundToInt(255 * linear_to_srgb_exact(i / (float)(SRGB_ENCODE_SIZE - 1)));
+        }
+    }
+};
+
+static inline const SRGB_Tables& srgb_tables(){
+    static const SRGB_Tables tables;
+    return tables;
+}
+
+static inline uint8_t linear_to_srgb_byte(const SRGB_Tables& t, float c){
+    return t.to_srgb[GRoundToInt(GPinToUnit(c) * (SRGB_ENCODE_SIZE - 1))];
+}
+
+// premultiplied encoded GPixel -> premultiplied linear A,R,G,B
+static inline void srgb_decode(const SRGB_Tables& t, GPixel pix, float out[4]){
+    unsigned a = GPixel_GetA(pix);
+    if(a == 0){
+        out[0] = out[1] = out[2] = out[3] = 0;
+        return;
+    }
+    float fa = a * (1.0f / 255);
+    uint32_t inv = t.unpremul[a];
+    out[0] = fa;
+    out[1] = t.to_linear[std::min(255u, (GPixel_GetR(pix) * inv + 0x8000) >> 16)] * fa;
+    out[2] = t.to_linear[std::min(255u, (GPixel_GetG(pix) * inv + 0x8000) >> 16)] * fa;
+    out[3] = t.to_linear[std::min(255u, (GPixel_GetB(pix) * inv + 0x8000) >> 16)] * fa;
+}
+
+// premultiplied linear A,R,G,B -> premultiplied encoded GPixel
+static inline GPixel srgb_encode(const SRGB_Tables& t, const float in[4]){
+    unsigned a = unit_to_byte(in[0]);
+    if(a == 0){
+        return 0;
+    }
+    float inv_a = 1 / in[0];
+    return GPixel_PackARGB(a, mul_div255(linear_to_srgb_byte(t, in[1] * inv_a), a),
+                              mul_div255(linear_to_srgb_byte(t, in[2] * inv_a), a),
+                              mul_div255(linear_to_srgb_byte(t, in[3] * inv_a), a));
+}
+
+// src-over on decoded premultiplied linear pixels: d = s + d*(1 - s_a)
+static inline void srgb_srcover_scalar(float d[4], const float s[4]){
+    for(int c = 0; c < 4; ++c){
+        d[c] = s[c] + d[c] * (1 - s[0]);
+    }
+}
+
+#ifdef __SSE2__
+static inline void srgb_srcover_sse2(float d[4], const float s[4]){
+    __m128 vs = _mm_loadu_ps(s);
+    __m128 vd = _mm_loadu_ps(d);
+    _mm_storeu_ps(d, _mm_add_ps(vs, _mm_mul_ps(vd, _mm_set1_ps(1 - s[0]))));
+}
+#endif
+
+static inline void srgb_srcover(float d[4], const float s[4]){
+#ifdef __SSE2__
+    srgb_srcover_sse2(d, s);
+#else
+    srgb_srcover_scalar(d, s);
+#endif
+}
+
+// src-over in linear space on sRGB encoded rows, blending each decoded pixel with srcover
+static inline void blend_srgb_row_with(void (*srcover)(float d[4], const float s[4]), const SRGB_Tables& t,
+                                       GPixel dst[], const GPixel src[], int count){
+    for(int i = 0; i < count; ++i){
+        unsigned src_a = GPixel_GetA(src[i]);
+        if(src_a == 0xFF){
+            dst[i] = src[i];
+            continue;
+        }
+        if(src_a == 0){
+            continue;
+        }
+        float s[4], d[4];
+        srgb_decode(t, src[i], s);
+        srgb_decode(t, dst[i], d);
+        srcover(d, s);
+        dst[i] = srgb_encode(t, d);
+    }
+}
+
+static inline void blend_srgb_row(const SRGB_Tables& t, GPixel dst[], const GPixel src[], int count){
+    blend_srgb_row_with(srgb_srcover, t, dst, src, count);
+}
+
+// same as blend_srgb_row without SSE2, so the two can be compared
+static inline void blend_srgb_row_scalar(const SRGB_Tables& t, GPixel dst[], const GPixel src[], int count){
+    blend_srgb_row_with(srgb_srcover_scalar, t, dst, src, count);
+}
+
+// linear gradient whose colors are interpolated in linear light rather than on encoded values
+GShader* linear_gradient_srgb(const GPoint& p0, const GPoint& p1, const GColor& c0, const GColor& c1,
+                              GShader::TileMode mode);
+
+#endif
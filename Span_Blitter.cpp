@@ -0,0 +1,335 @@
+#include "GPixel.h"
+#include "GBitmap.h"
+#include "Pixel_Math.h"
+#include "Pixel_Formats.h"
+#include "SRGB_Tables.h"
+#include "Dirty_Region.h"
+#include <algorithm>
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+
+// Writes premultiplied spans into one destination format. Chosen once when the
+// canvas is created so the scan converter never branches on format per pixel.
+class SpanBlitter{
+    public:
+    virtual ~SpanBlitter() {}
+    // src-over count shaded pixels onto the destination starting at (x,y)
+    virtual void blend_row(int x, int y, int count, const GPixel src[]) = 0;
+    // src-over a single color
+    virtual void blend_color(int x, int y, int count, GPixel src) = 0;
+    // overwrite, used by clear
+    virtual void fill_color(int x, int y, int count, GPixel src) = 0;
+};
+
+class ARGB_Blitter: public SpanBlitter{
+    public:
+    const GBitmap dst;
+
+    ARGB_Blitter(const GBitmap& new_dst): dst(new_dst){}
+
+    void blend_row(int x, int y, int count, const GPixel src[]){
+        blend_srcover_row(dst.getAddr(x,y),src,count);
+    }
+
+    void blend_color(int x, int y, int count, GPixel src){
+        blend_srcover_color_row(dst.getAddr(x,y),src,count);
+    }
+
+    void fill_color(int x, int y, int count, GPixel src){
+        GPixel* row = dst.getAddr(x,y);
+        for(int i = 0; i < count; ++i){
+            row[i] = src;
+        }
+    }
+};
+
+static inline GPixel swap_rb(GPixel pix){
+    return (pix & 0xFF00FF00) | ((pix >> 16) & 0xFF) | ((pix & 0xFF) << 16);
+}
+
+class BGRA_Blitter: public SpanBlitter{
+    public:
+    const FormatBitmap dst;
+
+    BGRA_Blitter(const FormatBitmap& new_dst): dst(new_dst){}
+
+    void blend_row(int x, int y, int count, const GPixel src[]){
+        GPixel swapped[count];
+        for(int i = 0; i < count; ++i){
+            swapped[i] = swap_rb(src[i]);
+        }
+        blend_srcover_row((GPixel*)dst.getAddr(x,y),swapped,count);
+    }
+
+    void blend_color(int x, int y, int count, GPixel src){
+        blend_srcover_color_row((GPixel*)dst.getAddr(x,y),swap_rb(src),count);
+    }
+
+    void fill_color(int x, int y, int count, GPixel src){
+        GPixel* row = (GPixel*)dst.getAddr(x,y);
+        GPixel swapped = swap_rb(src);
+        for(int i = 0; i < count; ++i){
+            row[i] = swapped;
+        }
+    }
+};
+
+// destination is opaque, so src-over reduces to src + dst*(1-src_a) on the colors only
+class RGB565_Blitter: public SpanBlitter{
+    public:
+    const FormatBitmap dst;
+
+    RGB565_Blitter(const FormatBitmap& new_dst): dst(new_dst){}
+
+    void blend_row(int x, int y, int count, const GPixel src[]){
+        uint16_t* row = (uint16_t*)dst.getAddr(x,y);
+        for(int i = 0; i < count; ++i){
+            unsigned src_a = GPixel_GetA(src[i]);
+            if(src_a == 0xFF){
+                row[i] = pack_565(src[i]);
+            }
+            else if(src_a != 0){
+                row[i] = pack_565(blend_srcover(src[i], expand_565(row[i])));
+            }
+        }
+    }
+
+    void blend_color(int x, int y, int count, GPixel src){
+        uint16_t* row = (uint16_t*)dst.getAddr(x,y);
+        unsigned src_a = GPixel_GetA(src);
+        if(src_a == 0xFF){
+            fill_color(x,y,count,src);
+            return;
+        }
+        if(src_a == 0){
+            return;
+        }
+        for(int i = 0; i < count; ++i){
+            row[i] = pack_565(blend_srcover(src, expand_565(row[i])));
+        }
+    }
+
+    void fill_color(int x, int y, int count, GPixel src){
+        uint16_t* row = (uint16_t*)dst.getAddr(x,y);
+        uint16_t c = pack_565(src);
+        for(int i = 0; i < count; ++i){
+            row[i] = c;
+        }
+    }
+};
+
+// coverage only: the colors of src are dropped
+class A8_Blitter: public SpanBlitter{
+    public:
+    const FormatBitmap dst;
+
+    A8_Blitter(const FormatBitmap& new_dst): dst(new_dst){}
+
+    void blend_row(int x, int y, int count, const GPixel src[]){
+        uint8_t* row = (uint8_t*)dst.getAddr(x,y);
+        for(int i = 0; i < count; ++i){
+            unsigned src_a = GPixel_GetA(src[i]);
+            row[i] = src_a + mul_div255(row[i], 255 - src_a);
+        }
+    }
+
+    void blend_color(int x, int y, int count, GPixel src){
+        uint8_t* row = (uint8_t*)dst.getAddr(x,y);
+        unsigned src_a = GPixel_GetA(src);
+        if(src_a == 0xFF){
+            memset(row, 0xFF, count);
+            return;
+        }
+        for(int i = 0; i < count; ++i){
+            row[i] = src_a + mul_div255(row[i], 255 - src_a);
+        }
+    }
+
+    void fill_color(int x, int y, int count, GPixel src){
+        memset(dst.getAddr(x,y), GPixel_GetA(src), count);
+    }
+};
+
+// decodes both sides through the tables, blends in linear light, re-encodes
+class SRGB_Blitter: public SpanBlitter{
+    public:
+    const FormatBitmap dst;
+    const SRGB_Tables& tables;
+
+    SRGB_Blitter(const FormatBitmap& new_dst): dst(new_dst), tables(srgb_tables()){}
+
+    void blend_row(int x, int y, int count, const GPixel src[]){
+        blend_srgb_row(tables,(GPixel*)dst.getAddr(x,y),src,count);
+    }
+
+    void blend_color(int x, int y, int count, GPixel src){
+        GPixel* row = (GPixel*)dst.getAddr(x,y);
+        unsigned src_a = GPixel_GetA(src);
+        if(src_a == 0xFF){
+            fill_color(x,y,count,src);
+            return;
+        }
+        if(src_a == 0){
+            return;
+        }
+        float s[4], d[4];
+        srgb_decode(tables,src,s);
+        for(int i = 0; i < count; ++i){
+            srgb_decode(tables,row[i],d);
+            srgb_srcover(d,s);
+            row[i] = srgb_encode(tables,d);
+        }
+    }
+
+    void fill_color(int x, int y, int count, GPixel src){
+        GPixel* row = (GPixel*)dst.getAddr(x,y);
+        for(int i = 0; i < count; ++i){
+            row[i] = src;
+        }
+    }
+};
+
+// Draws into an offscreen covering [left, left+width) x [top, top+height) of the canvas,
+// dropping whatever falls outside of it.
+class Layer_Blitter: public SpanBlitter{
+    public:
+    const GBitmap dst;
+    const int left;
+    const int top;
+
+    Layer_Blitter(const GBitmap& new_dst, int new_left, int new_top): dst(new_dst), left(new_left), top(new_top){}
+
+    // moves [x, x+count) of canvas row y into the layer, skip is how many pixels were cut on the left
+    bool clip(int& x, int& y, int& count, int& skip){
+        x -= left;
+        y -= top;
+        skip = std::max(0, -x);
+        x += skip;
+        count = std::min(count - skip, dst.width() - x);
+        return y >= 0 && y < dst.height() && count > 0;
+    }
+
+    void blend_row(int x, int y, int count, const GPixel src[]){
+        int skip;
+        if(clip(x,y,count,skip)){
+            blend_srcover_row(dst.getAddr(x,y),src + skip,count);
+        }
+    }
+
+    void blend_color(int x, int y, int count, GPixel src){
+        int skip;
+        if(clip(x,y,count,skip)){
+            blend_srcover_color_row(dst.getAddr(x,y),src,count);
+        }
+    }
+
+    void fill_color(int x, int y, int count, GPixel src){
+        int skip;
+        if(clip(x,y,count,skip)){
+            GPixel* row = dst.getAddr(x,y);
+            for(int i = 0; i < count; ++i){
+                row[i] = src;
+            }
+        }
+    }
+};
+
+// Binary coverage of a filled shape, stored as runs of covered pixels per row.
+struct CoverageMask {
+    int fLeft, fTop;            // device offset of the mask's first pixel
+    int fWidth, fHeight;
+    std::vector<int> fRowStart; // fHeight+1 offsets into fRuns
+    std::vector<int> fRuns;     // [start, end) pairs, relative to fLeft
+};
+
+// Records where a fill would write instead of writing. Rows must arrive in ascending
+// order and the runs of a row left to right, as the scan converter emits them.
+class Mask_Recorder: public SpanBlitter{
+    public:
+    CoverageMask* mask;
+
+    Mask_Recorder(CoverageMask* new_mask): mask(new_mask){
+        mask->fRowStart.clear();
+        mask->fRuns.clear();
+    }
+
+    void record(int x, int y, int count){
+        while((int)mask->fRowStart.size() <= y){
+            mask->fRowStart.push_back((int)mask->fRuns.size());
+        }
+        mask->fRuns.push_back(x);
+        mask->fRuns.push_back(x + count);
+    }
+
+    // closes the row table once the fill is done
+    void finish(){
+        while((int)mask->fRowStart.size() <= mask->fHeight){
+            mask->fRowStart.push_back((int)mask->fRuns.size());
+        }
+    }
+
+    void blend_row(int x, int y, int count, const GPixel src[]){
+        record(x,y,count);
+    }
+
+    void blend_color(int x, int y, int count, GPixel src){
+        record(x,y,count);
+    }
+
+    void fill_color(int x, int y, int count, GPixel src){
+        record(x,y,count);
+    }
+};
+
+// Forwards to another blitter, adding each span it is given to a DirtyRegion.
+class Dirty_Blitter: public SpanBlitter{
+    public:
+    SpanBlitter* const dst;
+    DirtyRegion* const region;
+    const int dx;
+    const int dy;
+
+    Dirty_Blitter(SpanBlitter* new_dst, DirtyRegion* new_region, int new_dx, int new_dy)
+        : dst(new_dst), region(new_region), dx(new_dx), dy(new_dy){}
+    ~Dirty_Blitter(){
+        delete dst;
+    }
+
+    void blend_row(int x, int y, int count, const GPixel src[]){
+        region->add_span(x + dx, y + dy, count);
+        dst->blend_row(x,y,count,src);
+    }
+
+    void blend_color(int x, int y, int count, GPixel src){
+        region->add_span(x + dx, y + dy, count);
+        dst->blend_color(x,y,count,src);
+    }
+
+    void fill_color(int x, int y, int count, GPixel src){
+        region->add_span(x + dx, y + dy, count);
+        dst->fill_color(x,y,count,src);
+    }
+};
+
+static SpanBlitter* make_span_blitter(const FormatBitmap& dst){
+    switch (dst.fFormat){
+        case PixelFormat::kARGB_8888: {
+            GBitmap bitmap;
+            bitmap.fWidth = dst.fWidth;
+            bitmap.fHeight = dst.fHeight;
+            bitmap.fRowBytes = dst.fRowBytes;
+            bitmap.fPixels = (GPixel*)dst.fPixels;
+            return new ARGB_Blitter(bitmap);
+        }
+        case PixelFormat::kBGRA_8888:
+            return new BGRA_Blitter(dst);
+        case PixelFormat::kRGB_565:
+            return new RGB565_Blitter(dst);
+        case PixelFormat::kA8:
+            return new A8_Blitter(dst);
+        case PixelFormat::kSRGB_8888:
+            return new SRGB_Blitter(dst);
+    }
+    return nullptr;
+}
@@ -7,11 +7,13 @@
 #include "GPoint.h"
 #include "GMatrix.h"
 #include "GShader.h"
+#include "Pixel_Math.h"
+#include "Float_Pipeline.h"
 #include <stdio.h>
 #include <cstdint>
 
 
-class TriColorShader: public GShader{
+class TriColorShader: public GShader, public FloatShader{
     public:
     const GColor c0, c1, c2;
     const GPoint p0, p1, p2;
@@ -19,7 +21,6 @@ class TriColorShader: public GShader{
     del_va, del_vr, del_vg, del_vb;
     GMatrix local_matrix;
     GMatrix final_matrix;
-    float shader_alpha;
 
     TriColorShader(const GPoint& new_p0, const GPoint& new_p1, const GPoint& new_p2,
     const GColor& new_c0, const GColor& new_c1, const GColor& new_c2)
@@ -39,8 +40,8 @@ class TriColorShader: public GShader{
         local_matrix =  GMatrix(del_p1x, del_p2x, p0.x(), del_p1y, del_p2y, p0.y());
     }
 
+    // paint alpha is applied to the shaded row by the canvas
     bool setContext(const GMatrix& new_ctm, float new_alpha){
-        shader_alpha = new_alpha;
         GMatrix tmp_matrix;
         tmp_matrix.setConcat(new_ctm, local_matrix);
         return tmp_matrix.invert(&final_matrix);
@@ -54,7 +55,7 @@ class TriColorShader: public GShader{
         float r = u*del_ur + v*del_vr + c0.fR;
         float g = u*del_ug + v*del_vg + c0.fG;
         float b = u*del_ub + v*del_vb + c0.fB;
-        row[0] = blend_with_alpha(a,r,g,b);
+        row[0] = premul_pixel(a,r,g,b);
         for (int i = 1; i< count; ++i){
             u+= final_matrix[GMatrix::SX];
             v+= final_matrix[GMatrix::KY];
@@ -62,16 +63,28 @@ class TriColorShader: public GShader{
             r = u*del_ur + v*del_vr + c0.fR;
             g = u*del_ug + v*del_vg + c0.fG;
             b = u*del_ub + v*del_vb + c0.fB;
-            row[i] = blend_with_alpha(a,r,g,b);
+            row[i] = premul_pixel(a,r,g,b);
         }
     }
 
-    GPixel blend_with_alpha(float a0,float r0,float g0,float b0){
+    void shadeRowF(int x, int y, int count, PixelF row[]){
+        GPoint start_loc = final_matrix.mapXY(x+0.5, y+0.5);
+        float u = start_loc.x();
+        float v = start_loc.y();
+        for (int i = 0; i< count; ++i){
+            row[i] = premul_to_float(u*del_ua + v*del_va + c0.fA, u*del_ur + v*del_vr + c0.fR,
+                                     u*del_ug + v*del_vg + c0.fG, u*del_ub + v*del_vb + c0.fB);
+            u+= final_matrix[GMatrix::SX];
+            v+= final_matrix[GMatrix::KY];
+        }
+    }
+
+    GPixel premul_pixel(float a0,float r0,float g0,float b0){
         //need to make sure the color has been pin to unit
-        int new_a = (uint8_t) (GPinToUnit(a0 * shader_alpha)*255);
-        int new_r = (uint8_t) (GPinToUnit(r0*a0 * shader_alpha)*255);
-        int new_g = (uint8_t) (GPinToUnit(g0 *a0 *shader_alpha)*255);
-        int new_b = (uint8_t) (GPinToUnit(b0 *a0* shader_alpha)*255);
+        int new_a = unit_to_byte(a0);
+        int new_r = unit_to_byte(r0*a0);
+        int new_g = unit_to_byte(g0 *a0);
+        int new_b = unit_to_byte(b0 *a0);
         GPixel the_pixel = GPixel_PackARGB(new_a, new_r, new_g, new_b);
         return the_pixel;
     }
@@ -8,7 +8,12 @@
 #include "GBitmap.h"
 #include "GCanvas.h"
 #include "GTime.h"
+#include "../Bitmap_Subset.h"
+#include "../Dirty_Region.h"
 #include <stdio.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
+#include <X11/extensions/XShm.h>
 
 GClick::GClick(GPoint loc, const char* name) {
     fCurr = fPrev = fOrig = loc;
@@ -19,6 +24,7 @@ GClick::GClick(GPoint loc, const char* name) {
 #define G_SelectInputMask (StructureNotifyMask | ExposureMask | KeyPressMask | ButtonPressMask | ButtonReleaseMask | PointerMotionMask)
 
 GWindow::GWindow(int width, int height) {
+    fShmImage = NULL;
     fDisplay = XOpenDisplay(NULL);
     if (!fDisplay) {
         fprintf(stderr, "can't open xdisplay\n");
@@ -42,12 +48,13 @@ GWindow::GWindow(int width, int height) {
     fGC = XCreateGC(fDisplay, fWindow, 0, NULL);
 
     this->setupBitmap(width, height);
-    fCanvas = GCanvas::Create(fBitmap);
+    fCanvas = create_tracking_canvas(fBitmap, &fDamage);
+    fInvalid.add(GIRect::MakeWH(width, height));
 }
 
 GWindow::~GWindow() {
     delete fCanvas;
-    free(fBitmap.fPixels);
+    this->releaseBitmap();
 
     if (fDisplay) {
         XFreeGC(fDisplay, fGC);
@@ -61,6 +68,13 @@ void GWindow::setTitle(const char title[]) {
 }
 
 void GWindow::requestDraw() {
+    this->requestDraw(GIRect::MakeWH(fWidth, fHeight));
+}
+
+// Only area is repainted, through onDrawArea, and only what gets drawn is pushed.
+void GWindow::requestDraw(const GIRect& area) {
+    fInvalid.add(GIRect::MakeLTRB(std::max(area.left(), 0), std::max(area.top(), 0),
+                                  std::min(area.right(), fWidth), std::min(area.bottom(), fHeight)));
     if (!fNeedDraw) {
         fNeedDraw = true;
         
@@ -87,12 +101,21 @@ bool GWindow::handleEvent(XEvent* evt) {
                 
                 delete fCanvas;
                 this->setupBitmap(w, h);
-                fCanvas = GCanvas::Create(fBitmap);
+                fCanvas = create_tracking_canvas(fBitmap, &fDamage);
+                fInvalid.clear();
+                fInvalid.add(GIRect::MakeWH(w, h));
+                fDamage.clear();
                 // assume we will get called to redraw
             }
             return true;
         }
         case Expose:
+            if (!evt->xexpose.send_event) {
+                // uncovered by the server, the bitmap still holds these pixels
+                fDamage.add(GIRect::MakeLTRB(evt->xexpose.x, evt->xexpose.y,
+                                             evt->xexpose.x + evt->xexpose.width,
+                                             evt->xexpose.y + evt->xexpose.height));
+            }
             if (0 == evt->xexpose.count) {
                 if (gDoTime) {
                     unsigned now = GTime::GetMSec();
@@ -107,7 +130,10 @@ bool GWindow::handleEvent(XEvent* evt) {
                 }
 
                 fNeedDraw = false;
-                this->onDraw(fCanvas);
+                if (gDoTime) {
+                    fInvalid.add(GIRect::MakeWH(fWidth, fHeight));
+                }
+                this->drawInvalid();
                 this->drawCanvasToWindow();
 
                 if (gDoTime) {
@@ -191,24 +217,146 @@ static void set_image_from_bitmap(XImage* image, const GBitmap& bitmap) {
     XInitImage(image);
 }
 
+void GWindow::onDrawArea(GCanvas* canvas, const GIRect&) {
+    this->onDraw(canvas);
+}
+
+// Each invalid rect is drawn through a canvas on that part of the bitmap, so draws are
+// clipped to it, while the canvas adds what it writes to fDamage.
+void GWindow::drawInvalid() {
+    const std::vector<GIRect> rects = fInvalid.rects();
+    fInvalid.clear();
+    for (size_t i = 0; i < rects.size(); ++i) {
+        const GIRect& r = rects[i];
+        GBitmap view;
+        if (r.left() == 0 && r.top() == 0 && r.right() == fWidth && r.bottom() == fHeight) {
+            this->onDrawArea(fCanvas, r);
+        } else if (extract_subset(fBitmap, r, &view)) {
+            GCanvas* canvas = create_tracking_canvas(view, &fDamage, r.left(), r.top());
+            canvas->translate(-r.left(), -r.top());
+            this->onDrawArea(canvas, r);
+            delete canvas;
+        }
+    }
+}
+
 void GWindow::drawCanvasToWindow() {
     XImage image;
-    set_image_from_bitmap(&image, fBitmap);
+    if (!fShmImage) {
+        set_image_from_bitmap(&image, fBitmap);
+    }
 
-    int x = 0;
-    int y = 0;
-    int w = fBitmap.width();
-    int h = fBitmap.height();
-    XPutImage(fDisplay, fWindow, fGC, &image, 0, 0, x, y, w, h);
+    const std::vector<GIRect>& rects = fDamage.rects();
+    for (size_t i = 0; i < rects.size(); ++i) {
+        int x = std::max(rects[i].left(), 0);
+        int y = std::max(rects[i].top(), 0);
+        int w = std::min(rects[i].right(), fBitmap.width()) - x;
+        int h = std::min(rects[i].bottom(), fBitmap.height()) - y;
+        if (w > 0 && h > 0) {
+            if (fShmImage) {
+                XShmPutImage(fDisplay, fWindow, fGC, fShmImage, x, y, x, y, w, h, False);
+            } else {
+                XPutImage(fDisplay, fWindow, fGC, &image, x, y, x, y, w, h);
+            }
+        }
+    }
+    if (fShmImage && !rects.empty()) {
+        // the server reads the segment after we return, so wait before drawing into it again
+        XSync(fDisplay, False);
+    }
+    fDamage.clear();
 }
 
-void GWindow::setupBitmap(int w, int h) {
-    if (fBitmap.fPixels) {
+static bool gShmAttachFailed;
+
+static int shm_attach_error(Display*, XErrorEvent*) {
+    gShmAttachFailed = true;
+    return 0;
+}
+
+// Shares the pixels with the server through a MIT-SHM segment, so presenting a frame
+// copies nothing over the socket. Fails on remote displays, without the extension, or
+// when the default visual is not laid out like GPixel, leaving the caller to malloc.
+bool GWindow::setupShmBitmap(int w, int h) {
+    if (!fDisplay || !XShmQueryExtension(fDisplay)) {
+        return false;
+    }
+
+    const int screenNo = DefaultScreen(fDisplay);
+    XImage* image = XShmCreateImage(fDisplay, DefaultVisual(fDisplay, screenNo),
+                                    DefaultDepth(fDisplay, screenNo), ZPixmap, NULL,
+                                    &fShmInfo, w, h);
+    if (!image) {
+        return false;
+    }
+    if (image->bits_per_pixel != 32 || image->byte_order != LSBFirst ||
+        image->red_mask != (0xFFu << GPIXEL_SHIFT_R) ||
+        image->green_mask != (0xFFu << GPIXEL_SHIFT_G) ||
+        image->blue_mask != (0xFFu << GPIXEL_SHIFT_B)) {
+        XDestroyImage(image);
+        return false;
+    }
+
+    fShmInfo.shmid = shmget(IPC_PRIVATE, image->bytes_per_line * image->height, IPC_CREAT | 0600);
+    if (fShmInfo.shmid < 0) {
+        XDestroyImage(image);
+        return false;
+    }
+    fShmInfo.shmaddr = image->data = (char*)shmat(fShmInfo.shmid, NULL, 0);
+    fShmInfo.readOnly = False;
+    if (fShmInfo.shmaddr == (char*)-1) {
+        shmctl(fShmInfo.shmid, IPC_RMID, NULL);
+        image->data = NULL;
+        XDestroyImage(image);
+        return false;
+    }
+
+    // a remote server accepts the request and then reports BadAccess, so trap it
+    gShmAttachFailed = false;
+    XErrorHandler prev = XSetErrorHandler(shm_attach_error);
+    Bool attached = XShmAttach(fDisplay, &fShmInfo);
+    XSync(fDisplay, False);
+    XSetErrorHandler(prev);
+
+    // once both sides are attached, the segment goes away with the last detach
+    shmctl(fShmInfo.shmid, IPC_RMID, NULL);
+    if (!attached || gShmAttachFailed) {
+        shmdt(fShmInfo.shmaddr);
+        image->data = NULL;
+        XDestroyImage(image);
+        return false;
+    }
+
+    fShmImage = image;
+    fBitmap.fPixels = (GPixel*)image->data;
+    fBitmap.fRowBytes = image->bytes_per_line;
+    return true;
+}
+
+void GWindow::releaseBitmap() {
+    if (fShmImage) {
+        XShmDetach(fDisplay, &fShmInfo);
+        XSync(fDisplay, False);
+        shmdt(fShmInfo.shmaddr);
+        fShmImage->data = NULL;
+        XDestroyImage(fShmImage);
+        fShmImage = NULL;
+    } else {
         free(fBitmap.fPixels);
     }
+    fBitmap.fPixels = NULL;
+}
+
+void GWindow::setupBitmap(int w, int h) {
+    this->releaseBitmap();
 
     fBitmap.fWidth = w;
     fBitmap.fHeight = h;
+    if (this->setupShmBitmap(w, h)) {
+        memset(fBitmap.fPixels, 0, fBitmap.fRowBytes * h);
+        return;
+    }
+
     fBitmap.fRowBytes = w * sizeof(GPixel);
     const size_t size = fBitmap.fRowBytes * fBitmap.fHeight;
     fBitmap.fPixels = (GPixel*)malloc(size);
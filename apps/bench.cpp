@@ -6,6 +6,7 @@
 #include "GCanvas.h"
 #include "GBitmap.h"
 #include "GTime.h"
+#include "../Owned_Bitmap.h"
 #include <memory>
 #include <string>
 #include <sys/stat.h>
@@ -72,11 +73,8 @@ static double compare(const GBitmap& a, const GBitmap& b, int tolerance, bool ve
 
 /////////////////////////////////////////////////////////////////////////////////////////////////
 
-static void setup_bitmap(GBitmap* bitmap, int w, int h) {
-    bitmap->fWidth = w;
-    bitmap->fHeight = h;
-    bitmap->fRowBytes = w * sizeof(GPixel);
-    bitmap->fPixels = (GPixel*)calloc(bitmap->rowBytes(), bitmap->height());
+static void setup_bitmap(OwnedBitmap* bitmap, int w, int h) {
+    bitmap->allocate(w, h);
 }
 
 static GPixel* get_addr(const GBitmap& bm, int x, int y) {
@@ -85,11 +83,11 @@ static GPixel* get_addr(const GBitmap& bm, int x, int y) {
     return bm.pixels() + x + y * (bm.rowBytes() >> 2);
 }
 
-static double handle_proc(GBenchmark* bench, const char path[], GBitmap* bitmap, bool forever) {
+static double handle_proc(GBenchmark* bench, const char path[], OwnedBitmap* bitmap, bool forever) {
     GISize size = bench->size();
     setup_bitmap(bitmap, size.fWidth, size.fHeight);
 
-    std::unique_ptr<GCanvas> canvas(GCanvas::Create(*bitmap));
+    std::unique_ptr<GCanvas> canvas(GCanvas::Create(bitmap->bitmap()));
     if (!canvas) {
         fprintf(stderr, "failed to create canvas for [%d %d] %s\n",
                 size.fWidth, size.fHeight, bench->name());
@@ -161,7 +159,7 @@ int main(int argc, char** argv) {
             printf("image: %s\n", name);
         }
         
-        GBitmap testBM;
+        OwnedBitmap testBM(&shared_pixel_pool());
         double dur = handle_proc(bench.get(), name, &testBM, forever);
         printf("bench: %s %g\n", name, dur);
 
@@ -170,10 +168,9 @@ int main(int argc, char** argv) {
             path += "/";
             path += name;
             path += ".png";
-            testBM.writeToFile(path.c_str());
+            testBM.bitmap().writeToFile(path.c_str());
 
         }
-        free(testBM.fPixels);
     }
     return 0;
 }
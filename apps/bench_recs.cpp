@@ -9,7 +9,10 @@
 #include "GShader.h"
 #include "GRandom.h"
 #include "GRect.h"
+#include "../Canvas_Extras.h"
+#include "../Float_Pipeline.h"
 #include <string>
+#include <vector>
 
 static GColor rand_color(GRandom& rand, bool forceOpaque = false) {
     GColor c { rand.nextF(), rand.nextF(), rand.nextF(), rand.nextF() };
@@ -31,25 +34,57 @@ static GRect rand_rect(GRandom& rand, const GRect& bounds) {
 }
 
 class RectsBench : public GBenchmark {
+protected:
     enum { W = 200, H = 200 };
+private:
     const bool fForceOpaque;
+    const bool fDeferred;
 public:
-    RectsBench(bool forceOpaque) : fForceOpaque(forceOpaque) {}
+    RectsBench(bool forceOpaque, bool deferred = false)
+        : fForceOpaque(forceOpaque), fDeferred(deferred) {}
     
-    const char* name() const override { return fForceOpaque ? "rects_opaque" : "rects_blend"; }
+    const char* name() const override {
+        if (fDeferred) {
+            return fForceOpaque ? "rects_opaque_deferred" : "rects_blend_deferred";
+        }
+        return fForceOpaque ? "rects_opaque" : "rects_blend";
+    }
     GISize size() const override { return { W, H }; }
     void draw(GCanvas* canvas) override {
         const int N = 500;
         const GRect bounds = GRect::MakeLTRB(-10, -10, W + 10, H + 10);
         GRandom rand;
+        if (fDeferred) {
+            canvas_begin_deferred(canvas);
+        }
         for (int i = 0; i < N; ++i) {
             GColor color = rand_color(rand, fForceOpaque);
             GRect rect = rand_rect(rand, bounds);
             canvas->fillRect(rect, color);
         }
+        if (fDeferred) {
+            canvas_end_deferred(canvas);
+        }
     }
 };
 
+// rects_blend drawn through create_float_canvas into its own float destination; the canvas the
+// harness passes in is left alone.
+class FloatRectsBench : public RectsBench {
+    const FloatFormat fFormat;
+    FloatBitmap fDst;
+    GCanvas* fCanvas;
+public:
+    FloatRectsBench(FloatFormat format)
+        : RectsBench(false), fFormat(format), fDst(W, H, format), fCanvas(create_float_canvas(fDst)) {}
+    ~FloatRectsBench() override { delete fCanvas; }
+
+    const char* name() const override {
+        return fFormat == FloatFormat::kF32 ? "rects_blend_f32" : "rects_blend_f16";
+    }
+    void draw(GCanvas*) override { RectsBench::draw(fCanvas); }
+};
+
 class SingleRectBench : public GBenchmark {
     const GISize    fSize;
     const GRect     fRect;
@@ -206,16 +241,18 @@ class StarBench : public GBenchmark {
     enum { W = 256, H = 256 };
     enum { N = 99 };
     GPoint fPts[N];
+    const bool fCached;
 public:
-    StarBench() {
+    StarBench(bool cached) : fCached(cached) {
         make_star(fPts, N, 0);
     }
     
     const char* name() const override {
-        return "star";
+        return fCached ? "star_cached" : "star";
     }
     GISize size() const override { return { W, H }; }
     void draw(GCanvas* canvas) override {
+        canvas_set_geometry_cache(canvas, fCached ? 1 : 0);
         canvas->translate(128, 128);
         canvas->scale(100, 100);
         GPaint paint;
@@ -226,9 +263,142 @@ public:
     }
 };
 
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+// circle of radius 1 at the origin, as four cubics
+static void add_circle(CurvePath* path) {
+    const float k = 0.5523f;
+    path->moveTo({1, 0});
+    path->cubicTo({1, k}, {k, 1}, {0, 1});
+    path->cubicTo({-k, 1}, {-1, k}, {-1, 0});
+    path->cubicTo({-1, -k}, {-k, -1}, {0, -1});
+    path->cubicTo({k, -1}, {1, -k}, {1, 0});
+}
+
+// circles of 8 sizes; with the mask cache on, each size is rasterized once per 1/4 pixel offset
+class CurvesBench : public GBenchmark {
+    enum { W = 200, H = 200 };
+    CurvePath fPath;
+    const bool fCached;
+public:
+    CurvesBench(bool cached) : fCached(cached) { add_circle(&fPath); }
+
+    const char* name() const override { return fCached ? "curves_cached" : "curves"; }
+    GISize size() const override { return { W, H }; }
+    void draw(GCanvas* canvas) override {
+        canvas_set_mask_cache(canvas, fCached ? 8 * 16 : 0);
+        const int N = 500;
+        GRandom rand;
+        for (int i = 0; i < N; ++i) {
+            GPaint paint(rand_color(rand, true));
+            const float radius = 5 + (i & 7) * 8;
+            canvas->save();
+            canvas->translate(rand.nextF() * W, rand.nextF() * H);
+            canvas->scale(radius, radius);
+            canvas_draw_path(canvas, fPath, paint);
+            canvas->restore();
+        }
+    }
+};
+
+// 500 sprites cut from a 64x64 atlas, a quarter of them scaled and rotated
+class AtlasBench : public GBenchmark {
+    enum { W = 256, H = 256, A = 64 };
+    std::vector<GPixel> fStorage;
+    GBitmap fAtlas;
+public:
+    AtlasBench() : fStorage(A * A) {
+        GRandom rand;
+        for (int i = 0; i < A * A; ++i) {
+            const GColor c = rand_color(rand, true);
+            fStorage[i] = GPixel_PackARGB(0xFF, (int)(c.fR * 255), (int)(c.fG * 255), (int)(c.fB * 255));
+        }
+        fAtlas.fWidth = A;
+        fAtlas.fHeight = A;
+        fAtlas.fRowBytes = A * sizeof(GPixel);
+        fAtlas.fPixels = fStorage.data();
+    }
+
+    const char* name() const override { return "atlas"; }
+    GISize size() const override { return { W, H }; }
+    void draw(GCanvas* canvas) override {
+        const int N = 500;
+        GMatrix xforms[N];
+        GIRect src[N];
+        GRandom rand;
+        for (int i = 0; i < N; ++i) {
+            const int x = (int)(rand.nextF() * (A - 16)), y = (int)(rand.nextF() * (A - 16));
+            src[i] = GIRect::MakeLTRB(x, y, x + 16, y + 16);
+            xforms[i].setTranslate(rand.nextF() * W, rand.nextF() * H);
+            if ((i & 3) == 0) {
+                xforms[i].preRotate(rand.nextF() * M_PI);
+                xforms[i].preScale(2, 2);
+            }
+        }
+        canvas_draw_atlas(canvas, fAtlas, xforms, src, nullptr, N, GPaint());
+    }
+};
+
+// 100 nine patches of a 32x32 bitmap with an 8 px border, stretched to random sizes
+class NinePatchBench : public GBenchmark {
+    enum { W = 256, H = 256, S = 32 };
+    std::vector<GPixel> fStorage;
+    GBitmap fBitmap;
+public:
+    NinePatchBench() : fStorage(S * S) {
+        for (int y = 0; y < S; ++y) {
+            for (int x = 0; x < S; ++x) {
+                fStorage[y * S + x] = GPixel_PackARGB(0xFF, x * 8, y * 8, 0x80);
+            }
+        }
+        fBitmap.fWidth = S;
+        fBitmap.fHeight = S;
+        fBitmap.fRowBytes = S * sizeof(GPixel);
+        fBitmap.fPixels = fStorage.data();
+    }
+
+    const char* name() const override { return "nine_patch"; }
+    GISize size() const override { return { W, H }; }
+    void draw(GCanvas* canvas) override {
+        const int N = 100;
+        const GIRect center = GIRect::MakeLTRB(8, 8, S - 8, S - 8);
+        GRandom rand;
+        for (int i = 0; i < N; ++i) {
+            const GRect dst = GRect::MakeXYWH(rand.nextF() * W / 2, rand.nextF() * H / 2,
+                                              16 + rand.nextF() * W / 2, 16 + rand.nextF() * H / 2);
+            canvas_draw_bitmap_nine(canvas, fBitmap, center, dst, GPaint());
+        }
+    }
+};
+
+// 20 groups of overlapping rects, each faded as a whole through a bounded layer
+class LayersBench : public GBenchmark {
+    enum { W = 256, H = 256 };
+public:
+    const char* name() const override { return "layers"; }
+    GISize size() const override { return { W, H }; }
+    void draw(GCanvas* canvas) override {
+        GRandom rand;
+        GPaint layer_paint;
+        layer_paint.setAlpha(0.5f);
+        for (int i = 0; i < 20; ++i) {
+            const GRect bounds = rand_rect(rand, GRect::MakeWH(W, H));
+            canvas_save_layer(canvas, &bounds, layer_paint);
+            for (int j = 0; j < 10; ++j) {
+                canvas->fillRect(rand_rect(rand, bounds), rand_color(rand, true));
+            }
+            canvas->restore();
+        }
+    }
+};
+
 const GBenchmark::Factory gBenchFactories[] {
     []() -> GBenchmark* { return new RectsBench(false); },
     []() -> GBenchmark* { return new RectsBench(true);  },
+    []() -> GBenchmark* { return new FloatRectsBench(FloatFormat::kF32); },
+    []() -> GBenchmark* { return new FloatRectsBench(FloatFormat::kF16); },
+    []() -> GBenchmark* { return new RectsBench(false, true); },
+    []() -> GBenchmark* { return new RectsBench(true, true);  },
     []() -> GBenchmark* {
         return new SingleRectBench({2,2}, GRect::MakeLTRB(-1000, -1000, 1002, 1002), "rect_big");
     },
@@ -246,7 +416,13 @@ const GBenchmark::Factory gBenchFactories[] {
 
     []() -> GBenchmark* { return new GradientBench(1);      },
     []() -> GBenchmark* { return new GradientBench(0.5);    },
-    []() -> GBenchmark* { return new StarBench;    },
+    []() -> GBenchmark* { return new StarBench(false); },
+    []() -> GBenchmark* { return new StarBench(true);  },
+    []() -> GBenchmark* { return new CurvesBench(false); },
+    []() -> GBenchmark* { return new CurvesBench(true);  },
+    []() -> GBenchmark* { return new AtlasBench; },
+    []() -> GBenchmark* { return new NinePatchBench; },
+    []() -> GBenchmark* { return new LayersBench; },
 
     nullptr,
 };
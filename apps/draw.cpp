@@ -13,6 +13,7 @@
 #include "GRect.h"
 #include "GShader.h"
 
+#include "../Canvas_Extras.h"
 #include "../mike_mesh.h"
 #include "../mike_utils.h"
 
@@ -128,6 +129,8 @@ public:
         canvas->restore();
     }
 
+    // local space area onDraw stays inside of
+    virtual GRect getBounds() { return this->getRect(); }
     virtual GRect getRect() = 0;
     virtual void setRect(const GRect&) {}
     virtual GColor getColor() = 0;
@@ -339,12 +342,19 @@ public:
         }
         
         const GColor* colors = fShowColors ? fColors : nullptr;
-        std::function<GPoint(MeshEdge, float)> eproc = [this](MeshEdge e, float t) {
-            return edge_proc(e, t);
-        };
-        mike_mesh(canvas, fPts, colors, paint, fLevel, fOffDiag,
-                  fUseCProc ? color_proc : nullptr,
-                  fUseEProc ? eproc : nullptr);
+        if (fUseCProc || fOffDiag) {
+            // the canvas patch only interpolates corner colors and splits quads one way
+            std::function<GPoint(MeshEdge, float)> eproc = [this](MeshEdge e, float t) {
+                return edge_proc(e, t);
+            };
+            mike_mesh(canvas, fPts, colors, paint, fLevel, fOffDiag,
+                      fUseCProc ? color_proc : nullptr,
+                      fUseEProc ? eproc : nullptr);
+        } else {
+            const GPoint tex[4] = { {0, 0}, {1, 0}, {1, 1}, {0, 1} };
+            canvas_draw_quad_patch(canvas, fPts, fUseEProc ? fOffCurve : nullptr, colors,
+                                   fShowBitmap ? tex : nullptr, paint, fLevel);
+        }
 
         if (fShowDiag) {
             this->show_diagonal(canvas, fLevel);
@@ -363,6 +373,22 @@ public:
         return GRect::MakeWH(200, 200);
     }
 
+    // the patch stays inside the hull of its corners and edge control points
+    GRect getBounds() override {
+        GRect r = GRect::MakeLTRB(fPts[0].fX, fPts[0].fY, fPts[0].fX, fPts[0].fY);
+        for (const GPoint& p : fPts) {
+            r = GRect::MakeLTRB(std::min(r.fLeft, p.fX), std::min(r.fTop, p.fY),
+                                std::max(r.fRight, p.fX), std::max(r.fBottom, p.fY));
+        }
+        if (fUseEProc) {
+            for (const GPoint& p : fOffCurve) {
+                r = GRect::MakeLTRB(std::min(r.fLeft, p.fX - 4), std::min(r.fTop, p.fY - 4),
+                                    std::max(r.fRight, p.fX + 4), std::max(r.fBottom, p.fY + 4));
+            }
+        }
+        return r;
+    }
+
     GColor getColor() override { return fColors[fCornerIndex]; }
     void setColor(const GColor& c) override { fColors[fCornerIndex] = c; }
 
@@ -441,6 +467,30 @@ static Shape* cons_up_shape(int index) {
     return NULL;
 }
 
+// device pixels shape and its hilite can touch
+static GIRect device_bounds(Shape* shape) {
+    const GRect r = shape->getBounds();
+    GPoint pts[4] = {
+        GPoint::Make(r.left(), r.top()), GPoint::Make(r.right(), r.top()),
+        GPoint::Make(r.right(), r.bottom()), GPoint::Make(r.left(), r.bottom()),
+    };
+    shape->computeMatrix().mapPoints(pts, pts, 4);
+    float l = pts[0].fX, t = pts[0].fY, rt = l, b = t;
+    for (int i = 1; i < 4; ++i) {
+        l = std::min(l, pts[i].fX);
+        t = std::min(t, pts[i].fY);
+        rt = std::max(rt, pts[i].fX);
+        b = std::max(b, pts[i].fY);
+    }
+    const float pad = CORNER_SIZE + 2;
+    return GIRect::MakeLTRB((int)floorf(l - pad), (int)floorf(t - pad),
+                            (int)ceilf(rt + pad), (int)ceilf(b + pad));
+}
+
+static bool intersects(const GIRect& a, const GIRect& b) {
+    return a.left() < b.right() && b.left() < a.right() && a.top() < b.bottom() && b.top() < a.bottom();
+}
+
 class ResizeClick : public GClick {
     GPoint  fAnchor;
 public:
@@ -466,10 +516,21 @@ public:
     
 protected:
     void onDraw(GCanvas* canvas) override {
+        this->drawShapes(canvas, NULL);
+    }
+
+    // canvas is already clipped to area, shapes that cannot reach it are skipped
+    void onDrawArea(GCanvas* canvas, const GIRect& area) override {
+        this->drawShapes(canvas, &area);
+    }
+
+    void drawShapes(GCanvas* canvas, const GIRect* area) {
         canvas->clear(fBGColor);
 
         for (int i = 0; i < fList.size(); ++i) {
-            fList[i]->draw(canvas);
+            if (!area || intersects(device_bounds(fList[i]), *area)) {
+                fList[i]->draw(canvas);
+            }
         }
         if (fShape && !fShape->drawHilite(canvas)) {
             canvas->save();
@@ -481,6 +542,7 @@ protected:
 
     bool onKeyPress(const XEvent&, KeySym sym) override {
         if (sym >= '1' && sym <= '9') {
+            this->invalidate(fShape);
             fShape = cons_up_shape(sym - '1');
             if (fShape) {
                 fList.push_back(fShape);
@@ -490,8 +552,9 @@ protected:
         }
 
         if (fShape) {
+            this->invalidate(fShape);
             if (fShape->doSym(sym)) {
-                this->requestDraw();
+                this->invalidate(fShape);
                 return true;
             }
             switch (sym) {
@@ -499,7 +562,6 @@ protected:
                     int index = find_index(fList, fShape);
                     if (index < fList.size() - 1) {
                         std::swap(fList[index], fList[index + 1]);
-                        this->requestDraw();
                         return true;
                     }
                     return false;
@@ -508,7 +570,6 @@ protected:
                     int index = find_index(fList, fShape);
                     if (index > 0) {
                         std::swap(fList[index], fList[index - 1]);
-                        this->requestDraw();
                         return true;
                     }
                     return false;
@@ -517,13 +578,12 @@ protected:
                     this->removeShape(fShape);
                     fShape = NULL;
                     this->updateTitle();
-                    this->requestDraw();
                     return true;
                 case XK_Left:
                 case XK_Right: {
                     const float rad = M_PI * 2 / 180;
                     fShape->preRotate(rad * (sym == XK_Left ? 1 : -1));
-                    this->requestDraw();
+                    this->invalidate(fShape);
                     return true;
                 }
                 default:
@@ -551,9 +611,9 @@ protected:
         } else {
             c.fA = 1;   // need the bg to stay opaque
             fBGColor = c;
+            this->requestDraw();
         }
         this->updateTitle();
-        this->requestDraw();
         return true;
     }
 
@@ -570,9 +630,11 @@ protected:
             }
         }
 
+        this->invalidate(fShape);
         for (int i = fList.size() - 1; i >= 0; --i) {
             if (contains(fList[i]->getRect(), loc.x(), loc.y())) {
                 fShape = fList[i];
+                this->invalidate(fShape);
                 this->updateTitle();
                 return new GClick(loc, "move");
             }
@@ -586,6 +648,7 @@ protected:
     }
 
     void onHandleClick(GClick* click) override {
+        this->invalidate(fShape);
         if (!click->doMove()) {
             if (click->isName("move")) {
                 const GPoint curr = click->curr();
@@ -604,10 +667,17 @@ protected:
             }
         }
         this->updateTitle();
-        this->requestDraw();
+        this->invalidate(fShape);
     }
 
 private:
+    // repaints what shape covers now, call before and after changing it
+    void invalidate(Shape* shape) {
+        if (shape) {
+            this->requestDraw(device_bounds(shape));
+        }
+    }
+
     void removeShape(Shape* target) {
         GASSERT(target);
 
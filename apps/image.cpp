@@ -7,6 +7,7 @@
 #include "image.h"
 #include "GCanvas.h"
 #include "GBitmap.h"
+#include "GRawBitmap.h"
 #include <string>
 #include <sys/stat.h>
 #include <unistd.h>
@@ -16,6 +17,16 @@ static bool is_dir(const char path[]) {
     return !stat(path, &status) && (status.st_mode & S_IFDIR);
 }
 
+// A raw copy is only trusted when it was written no earlier than the png next to it (or
+// there is no png), so regenerating the png never leaves a stale .graw in charge.
+static bool raw_is_current(const std::string& raw_path, const std::string& png_path) {
+    struct stat raw, png;
+    if (stat(raw_path.c_str(), &raw)) {
+        return false;
+    }
+    return stat(png_path.c_str(), &png) || raw.st_mtime >= png.st_mtime;
+}
+
 static bool mk_dir(const char path[]) {
     if (is_dir(path)) {
         return true;
@@ -188,6 +199,7 @@ int main(int argc, char** argv) {
     FILE* reportFile = NULL;
     FILE* diffFile = NULL;
     int tolerance = 0;
+    bool writeRaw = false;
 
     for (int i = 1; i < argc; ++i) {
         if (is_arg(argv[i], "report") && i+2 < argc) {
@@ -198,6 +210,8 @@ int main(int argc, char** argv) {
                 printf("----- can't open %s for author %s\n", report, author);
                 return -1;
             }
+        } else if (is_arg(argv[i], "graw")) {
+            writeRaw = true;
         } else if (is_arg(argv[i], "verbose")) {
             verbose = true;
         } else if (is_arg(argv[i], "write") && i+1 < argc) {
@@ -252,23 +266,44 @@ int main(int argc, char** argv) {
         
         GBitmap testBM;
         handle_proc(gDrawRecs[i], path.c_str(), &testBM);
+        if (writeRaw) {
+            std::string raw_path(root);
+            raw_path += gDrawRecs[i].fName;
+            raw_path += ".graw";
+            if (!GWriteRawBitmap(testBM, raw_path.c_str())) {
+                fprintf(stderr, "failed to write %s\n", raw_path.c_str());
+            }
+        }
 
         if (expected) {
             std::string exp_path(expected);
             exp_path += "/";
             exp_path += gDrawRecs[i].fName;
-            exp_path += ".png";
-            GBitmap expectedBM;
-    
-            if (!expectedBM.readFromFile(exp_path.c_str())) {
+
+            // a raw copy of the expected image maps instantly, the png has to be decoded
+            GMappedBitmap mapped;
+            GBitmap decoded;
+            decoded.fPixels = NULL;
+            const GBitmap* expectedBM = &mapped.bitmap();
+            const std::string raw_path = exp_path + ".graw";
+            if (!raw_is_current(raw_path, exp_path + ".png") || !mapped.map(raw_path.c_str())) {
+                expectedBM = &decoded;
+                exp_path += ".png";
+            }
+
+            if (!mapped.isMapped() && !decoded.readFromFile(exp_path.c_str())) {
                 printf("- failed to load <%s>\n", exp_path.c_str());
+            } else if (expectedBM->width() != testBM.width() ||
+                       expectedBM->height() != testBM.height()) {
+                printf("- size mismatch <%s>\n", exp_path.c_str());
             } else {
-                double correct = compare(testBM, expectedBM, tolerance, verbose);
+                double correct = compare(testBM, *expectedBM, tolerance, verbose);
                 if (correct < 1 && diffFile != NULL) {
-                    add_diff_to_file(diffFile, testBM, expectedBM, diffDir, gDrawRecs[i].fName);
+                    add_diff_to_file(diffFile, testBM, *expectedBM, diffDir, gDrawRecs[i].fName);
                 }
                 percent_correct += correct * weight;
             }
+            free(decoded.fPixels);
         }
         
         free(testBM.fPixels);
@@ -8,8 +8,25 @@
 #include "GMatrix.h"
 #include "GPath.h"
 #include "GPoint.h"
+#include "GRandom.h"
 #include "GRect.h"
+#include "GShader.h"
 #include "tests.h"
+#include "../Bitmap_Subset.h"
+#include "../Canvas_Extras.h"
+#include "../Dirty_Region.h"
+#include "../Float_Pipeline.h"
+#include "../Owned_Bitmap.h"
+#include "../Pixel_Formats.h"
+#include "../Pixel_Math.h"
+#include "../SRGB_Tables.h"
+#include "../src/GPNGCodec.h"
+#include "../src/GRawBitmap.h"
+#include <png.h>
+#include <stdio.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
 
 static void setup_bitmap(GBitmap* bitmap, int w, int h) {
     bitmap->fWidth = w;
@@ -352,6 +369,95 @@ static void test_offscreen_poly(GTestStats* stats) {
     stats->expectTrue(is_filled_with(surface.bitmap(), white), "poly_offscreen");
 }
 
+// Polygons near the right/bottom edges of a non-square canvas are still drawn when they
+// cover any pixel center.
+static void test_edge_poly(GTestStats* stats) {
+    GSurface surface(10, 20);
+    GCanvas* canvas = surface.canvas();
+    const GBitmap& bm = surface.bitmap();
+    const GColor color = GColor::MakeARGB(1, 0, 0, 0);  // black
+    const GPixel black = GPixel_PackARGB(0xFF, 0, 0, 0);
+    const GPixel white = GPixel_PackARGB(0xFF, 0xFF, 0xFF, 0xFF);
+
+    // below y == width, but well inside the height
+    canvas->clear(GColor::MakeARGB(1, 1, 1, 1));
+    const GPoint low[] = {
+        GPoint::Make(2, 12), GPoint::Make(8, 12), GPoint::Make(8, 16), GPoint::Make(2, 16)
+    };
+    canvas->fillConvexPolygon(low, 4, color);
+    stats->expectTrue(*bm.getAddr(5, 14) == black && *bm.getAddr(5, 11) == white,
+                      "poly_below_width");
+
+    // a sliver left of the last column's center still covers it
+    canvas->clear(GColor::MakeARGB(1, 1, 1, 1));
+    const GPoint sliver[] = {
+        GPoint::Make(9.2f, 2), GPoint::Make(9.8f, 2), GPoint::Make(9.8f, 6), GPoint::Make(9.2f, 6)
+    };
+    canvas->fillConvexPolygon(sliver, 4, color);
+    stats->expectTrue(*bm.getAddr(9, 4) == black && *bm.getAddr(8, 4) == white,
+                      "poly_last_column");
+
+    // and past the last column's center nothing is covered
+    canvas->clear(GColor::MakeARGB(1, 1, 1, 1));
+    const GPoint past[] = {
+        GPoint::Make(9.6f, 2), GPoint::Make(12, 2), GPoint::Make(12, 6), GPoint::Make(9.6f, 6)
+    };
+    canvas->fillConvexPolygon(past, 4, color);
+    stats->expectTrue(is_filled_with(bm, white), "poly_past_last_column");
+}
+
+// The slanted edge lies wholly above the canvas; clipping it leaves zero height, and it must not
+// leave a winding behind in the first row.
+static void test_clipped_edges(GTestStats* stats) {
+    GSurface surface(40, 12);
+    GCanvas* canvas = surface.canvas();
+    canvas->clear(GColor::MakeARGB(0, 0, 0, 0));
+
+    const GPoint pts[] = {
+        GPoint::Make(5, -20), GPoint::Make(10, -5), GPoint::Make(30, -5),
+        GPoint::Make(30, 10), GPoint::Make(5, 10),
+    };
+    const GContour ctr = { GARRAY_COUNT(pts), pts, true };
+    canvas->drawContours(&ctr, 1, GPaint(GColor::MakeARGB(1, 0, 0, 1)));
+
+    const GPixel blue = GPixel_PackARGB(0xFF, 0, 0, 0xFF);
+    bool ok = true;
+    for (int y = 0; y < 12; ++y) {
+        for (int x = 0; x < 40; ++x) {
+            const bool inside = y < 10 && x >= 5 && x < 30;
+            ok &= *surface.bitmap().getAddr(x, y) == (inside ? blue : 0);
+        }
+    }
+    stats->expectTrue(ok, "clipped_edges_zero_height");
+}
+
+// A clamped gradient whose row starts left of p0: every pixel is the lerp at its own center.
+static void test_gradient_clamp(GTestStats* stats) {
+    GSurface surface(48, 2);
+    GCanvas* canvas = surface.canvas();
+    canvas->clear(GColor::MakeARGB(0, 0, 0, 0));
+    const GColor c0 = GColor::MakeARGB(1, 1, 0, 0), c1 = GColor::MakeARGB(0.4f, 0, 0.6f, 1);
+    GShader* shader = GShader::LinearGradient(GPoint::Make(4, 0), GPoint::Make(44, 0), c0, c1);
+    canvas->drawRect(GRect::MakeWH(48, 2), GPaint(shader));
+    delete shader;
+
+    bool ok = true;
+    for (int x = 0; x < 48; ++x) {
+        const float t = std::max(0.0f, std::min(1.0f, (x + 0.5f - 4) / 40));
+        const float a = c0.fA + (c1.fA - c0.fA) * t;
+        const float c[] = {
+            a, (c0.fR + (c1.fR - c0.fR) * t) * a, (c0.fG + (c1.fG - c0.fG) * t) * a,
+            (c0.fB + (c1.fB - c0.fB) * t) * a,
+        };
+        const GPixel p = *surface.bitmap().getAddr(x, 1);
+        const int actual[] = { GPixel_GetA(p), GPixel_GetR(p), GPixel_GetG(p), GPixel_GetB(p) };
+        for (int i = 0; i < 4; ++i) {
+            ok &= abs(actual[i] - (int)(c[i] * 255 + 0.5f)) <= 1;
+        }
+    }
+    stats->expectTrue(ok, "gradient_clamp_lerp");
+}
+
 static bool ie_eq(float a, float b) {
     return fabs(a - b) <= 0.00001f;
 }
@@ -384,6 +490,1518 @@ static void test_matrix(GTestStats* stats) {
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 
+static GPixel raw_pixel(unsigned a, unsigned r, unsigned g, unsigned b) {
+    return (a << GPIXEL_SHIFT_A) | (r << GPIXEL_SHIFT_R) | (g << GPIXEL_SHIFT_G) | (b << GPIXEL_SHIFT_B);
+}
+
+static void test_div255(GTestStats* stats) {
+    bool exact = true;
+    for (unsigned x = 0; x <= 255 * 255; ++x) {
+        exact &= div255(x) == (unsigned)floor(x / 255.0 + 0.5);
+    }
+    stats->expectTrue(exact, "div255_exact");
+
+    // scale_pixel works on two channels per multiply, each must still round on its own
+    bool scaled = true;
+    for (unsigned c = 0; c <= 255; ++c) {
+        const GPixel pix = raw_pixel(c, 255 - c, c >> 1, c ^ 0x55);
+        for (unsigned s = 0; s <= 255; ++s) {
+            scaled &= scale_pixel(pix, s) == raw_pixel(mul_div255(c, s), mul_div255(255 - c, s),
+                                                       mul_div255(c >> 1, s), mul_div255(c ^ 0x55, s));
+        }
+    }
+    stats->expectTrue(scaled, "scale_pixel_exact");
+
+    // the row helpers take a vector path for most of a row, it must match the scalar math
+    GPixel src[37], dst[37], row[37], expected[37];
+    for (int i = 0; i < 37; ++i) {
+        const unsigned a = (i * 53) & 0xFF;
+        src[i] = GPixel_PackARGB(a, a >> 1, a / 3, a);
+        dst[i] = GPixel_PackARGB(0xFF, (i * 31) & 0xFF, 0x80, i);
+        expected[i] = blend_srcover(src[i], dst[i]);
+    }
+    memcpy(row, dst, sizeof(row));
+    blend_srcover_row(row, src, 37);
+    stats->expectEQ(memcmp(row, expected, sizeof(row)), 0, "blend_srcover_row");
+
+    for (int i = 0; i < 37; ++i) {
+        expected[i] = scale_pixel(dst[i], 77);
+    }
+    memcpy(row, dst, sizeof(row));
+    scale_row(row, 37, 77);
+    stats->expectEQ(memcmp(row, expected, sizeof(row)), 0, "scale_row");
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+// Pixels whose center is more than 3/4 of a pixel from the outline must be filled exactly when
+// their center is inside; the ones closer to it may go either way.
+template <typename Inside>
+static bool matches_shape(const GBitmap& bitmap, GPixel fill, const std::vector<GPoint>& outline,
+                          Inside inside) {
+    for (int y = 0; y < bitmap.height(); ++y) {
+        for (int x = 0; x < bitmap.width(); ++x) {
+            const float cx = x + 0.5f, cy = y + 0.5f;
+            float dist = 1e9f;
+            for (size_t i = 0; i < outline.size(); ++i) {
+                dist = std::min(dist, hypotf(outline[i].fX - cx, outline[i].fY - cy));
+            }
+            if (dist > 0.75f && (*bitmap.getAddr(x, y) == fill) != inside(cx, cy)) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+static void test_path_quad(GTestStats* stats) {
+    GSurface surface(32, 32);
+    GCanvas* canvas = surface.canvas();
+    canvas->clear(GColor::MakeARGB(0, 0, 0, 0));
+
+    // y = 28 - 96t + 96t^2 over x = 4 + 24t, closed along y = 28
+    CurvePath path;
+    path.moveTo(GPoint::Make(4, 28)).quadTo(GPoint::Make(16, -20), GPoint::Make(28, 28));
+    canvas_draw_path(canvas, path, GPaint(GColor::MakeARGB(1, 0, 0, 1)));
+
+    std::vector<GPoint> outline;
+    for (int i = 0; i <= 2000; ++i) {
+        const float t = i / 2000.0f;
+        outline.push_back(GPoint::Make(4 + 24 * t, 28 - 96 * t + 96 * t * t));
+        outline.push_back(GPoint::Make(4 + 24 * t, 28));
+    }
+    const bool ok = matches_shape(surface.bitmap(), GPixel_PackARGB(0xFF, 0, 0, 0xFF), outline,
+                                  [](float x, float y) {
+        const float t = (x - 4) / 24;
+        return t > 0 && t < 1 && y < 28 && y > 28 - 96 * t + 96 * t * t;
+    });
+    stats->expectTrue(ok, "path_quad");
+
+    // the same path through a scaling CTM covers the scaled shape
+    canvas->clear(GColor::MakeARGB(0, 0, 0, 0));
+    canvas->scale(0.5f, 0.5f);
+    canvas_draw_path(canvas, path, GPaint(GColor::MakeARGB(1, 0, 0, 1)));
+    for (size_t i = 0; i < outline.size(); ++i) {
+        outline[i].set(outline[i].fX * 0.5f, outline[i].fY * 0.5f);
+    }
+    const bool scaled = matches_shape(surface.bitmap(), GPixel_PackARGB(0xFF, 0, 0, 0xFF), outline,
+                                      [](float x, float y) {
+        const float t = (2 * x - 4) / 24;
+        return t > 0 && t < 1 && 2 * y < 28 && 2 * y > 28 - 96 * t + 96 * t * t;
+    });
+    stats->expectTrue(scaled, "path_quad_scaled");
+}
+
+static void test_path_cubic(GTestStats* stats) {
+    GSurface surface(32, 32);
+    GCanvas* canvas = surface.canvas();
+    const GPixel blue = GPixel_PackARGB(0xFF, 0, 0, 0xFF);
+    canvas->clear(GColor::MakeARGB(0, 0, 0, 0));
+
+    // four cubics approximating a circle of radius 12, well within a pixel of the true circle
+    const float k = 0.5523f;
+    CurvePath circle;
+    circle.moveTo(GPoint::Make(1, 0));
+    circle.cubicTo(GPoint::Make(1, k), GPoint::Make(k, 1), GPoint::Make(0, 1));
+    circle.cubicTo(GPoint::Make(-k, 1), GPoint::Make(-1, k), GPoint::Make(-1, 0));
+    circle.cubicTo(GPoint::Make(-1, -k), GPoint::Make(-k, -1), GPoint::Make(0, -1));
+    circle.cubicTo(GPoint::Make(k, -1), GPoint::Make(1, -k), GPoint::Make(1, 0));
+    canvas->save();
+    canvas->translate(16, 16);
+    canvas->scale(12, 12);
+    canvas_draw_path(canvas, circle, GPaint(GColor::MakeARGB(1, 0, 0, 1)));
+    canvas->restore();
+
+    std::vector<GPoint> outline;
+    for (int i = 0; i < 2000; ++i) {
+        const float angle = i * 2 * M_PI / 2000;
+        outline.push_back(GPoint::Make(16 + 12 * cosf(angle), 16 + 12 * sinf(angle)));
+    }
+    stats->expectTrue(matches_shape(surface.bitmap(), blue, outline, [](float x, float y) {
+        return hypotf(x - 16, y - 16) < 12;
+    }), "path_cubic_circle");
+
+    // a cubic with two y extrema, split into three monotonic edges by the rasterizer
+    canvas->clear(GColor::MakeARGB(0, 0, 0, 0));
+    const GPoint s[4] = {
+        GPoint::Make(4, 16), GPoint::Make(12, -14), GPoint::Make(20, 46), GPoint::Make(28, 16)
+    };
+    CurvePath wave;
+    wave.moveTo(s[0]).cubicTo(s[1], s[2], s[3]).lineTo(GPoint::Make(28, 30)).lineTo(GPoint::Make(4, 30));
+    canvas_draw_path(canvas, wave, GPaint(GColor::MakeARGB(1, 0, 0, 1)));
+
+    outline.clear();
+    for (int i = 0; i <= 2000; ++i) {
+        const float t = i / 2000.0f, mt = 1 - t;
+        const float a = mt * mt * mt, b = 3 * mt * mt * t, c = 3 * mt * t * t, d = t * t * t;
+        outline.push_back(GPoint::Make(a * s[0].fX + b * s[1].fX + c * s[2].fX + d * s[3].fX,
+                                       a * s[0].fY + b * s[1].fY + c * s[2].fY + d * s[3].fY));
+        outline.push_back(GPoint::Make(4 + 24 * t, 30));
+        outline.push_back(GPoint::Make(4, 16 + 14 * t));
+        outline.push_back(GPoint::Make(28, 16 + 14 * t));
+    }
+    stats->expectTrue(matches_shape(surface.bitmap(), blue, outline, [&wave](float x, float y) {
+        return wave.contains(x, y);
+    }), "path_cubic_wave");
+}
+
+static bool bitmaps_eq(const GBitmap& a, const GBitmap& b) {
+    for (int y = 0; y < a.height(); ++y) {
+        if (memcmp(a.getAddr(0, y), b.getAddr(0, y), a.width() * sizeof(GPixel))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void test_quad_patch(GTestStats* stats) {
+    GSurface surface(32, 32), expected(32, 32);
+    GCanvas* canvas = surface.canvas();
+    const GColor blue = GColor::MakeARGB(1, 0, 0, 1);
+    const GPoint corners[4] = {
+        GPoint::Make(4, 4), GPoint::Make(28, 4), GPoint::Make(28, 28), GPoint::Make(4, 28)
+    };
+
+    // straight edges tile the rect exactly, with no seams or overlap between the triangles
+    canvas->clear(GColor::MakeARGB(0, 0, 0, 0));
+    canvas_draw_quad_patch(canvas, corners, NULL, NULL, NULL, GPaint(blue));
+    expected.canvas()->clear(GColor::MakeARGB(0, 0, 0, 0));
+    expected.canvas()->fillRect(GRect::MakeLTRB(4, 4, 28, 28), blue);
+    stats->expectTrue(bitmaps_eq(surface.bitmap(), expected.bitmap()), "quad_patch_rect");
+
+    // pulling the top edge's control points up bulges the patch above the rect
+    const GPoint off_curve[8] = {
+        GPoint::Make(12, -4), GPoint::Make(20, -4),    // top
+        GPoint::Make(28, 12), GPoint::Make(28, 20),    // right
+        GPoint::Make(12, 28), GPoint::Make(20, 28),    // bottom
+        GPoint::Make(4, 12),  GPoint::Make(4, 20),     // left
+    };
+    canvas->clear(GColor::MakeARGB(0, 0, 0, 0));
+    canvas_draw_quad_patch(canvas, corners, off_curve, NULL, NULL, GPaint(blue));
+    stats->expectEQ(*surface.bitmap().getAddr(16, 1), GPixel_PackARGB(0xFF, 0, 0, 0xFF),
+                    "quad_patch_bulge");
+    stats->expectEQ(*surface.bitmap().getAddr(5, 1), 0u, "quad_patch_bulge_corner");
+
+    // corner colors are interpolated across the patch
+    const GColor colors[4] = {
+        GColor::MakeARGB(1, 1, 0, 0), GColor::MakeARGB(1, 0, 1, 0),
+        GColor::MakeARGB(1, 0, 0, 1), GColor::MakeARGB(1, 0, 0, 0),
+    };
+    canvas->clear(GColor::MakeARGB(0, 0, 0, 0));
+    canvas_draw_quad_patch(canvas, corners, NULL, colors, NULL, GPaint());
+    stats->expectTrue(GPixel_GetR(*surface.bitmap().getAddr(4, 4)) > 0xE0, "quad_patch_color_0");
+    stats->expectTrue(GPixel_GetG(*surface.bitmap().getAddr(27, 4)) > 0xE0, "quad_patch_color_1");
+    stats->expectTrue(GPixel_GetB(*surface.bitmap().getAddr(27, 27)) > 0xE0, "quad_patch_color_2");
+    bool ramp = true;
+    for (int x = 5; x < 28; ++x) {
+        const GPixel prev = *surface.bitmap().getAddr(x - 1, 4), curr = *surface.bitmap().getAddr(x, 4);
+        ramp &= GPixel_GetR(curr) <= GPixel_GetR(prev) && GPixel_GetG(curr) >= GPixel_GetG(prev);
+    }
+    stats->expectTrue(ramp, "quad_patch_color_ramp");
+
+    // an explicit level of 1 is the two triangles of the corners
+    const int indices[6] = { 0, 1, 2, 0, 2, 3 };
+    canvas->clear(GColor::MakeARGB(0, 0, 0, 0));
+    canvas_draw_quad_patch(canvas, corners, NULL, colors, NULL, GPaint(), 1);
+    expected.canvas()->clear(GColor::MakeARGB(0, 0, 0, 0));
+    expected.canvas()->drawMesh(2, corners, indices, colors, NULL, GPaint());
+    stats->expectTrue(bitmaps_eq(surface.bitmap(), expected.bitmap()), "quad_patch_level_1");
+
+    // the largest level (8192 triangles through drawMesh) still tiles the rect exactly
+    const GColor blues[4] = { blue, blue, blue, blue };
+    canvas->clear(GColor::MakeARGB(0, 0, 0, 0));
+    canvas_draw_quad_patch(canvas, corners, NULL, blues, NULL, GPaint(), 64);
+    expected.canvas()->clear(GColor::MakeARGB(0, 0, 0, 0));
+    expected.canvas()->fillRect(GRect::MakeLTRB(4, 4, 28, 28), blue);
+    stats->expectTrue(bitmaps_eq(surface.bitmap(), expected.bitmap()), "quad_patch_level_64");
+}
+
+// Pans a rotated star back and forth with the geometry cache on; every frame must match drawing
+// the same frame without the cache. The star has enough edges that shifting cached device points
+// by the pan, instead of mapping at the new translation, rounds some edge differently.
+static void test_geometry_cache(GTestStats* stats) {
+    GSurface cached(64, 64), plain(64, 64);
+    canvas_set_geometry_cache(cached.canvas(), 4);
+
+    GPoint star[101];
+    for (int i = 0; i < 101; ++i) {
+        const float angle = i * 2 * M_PI * 50 / 101;
+        star[i].set(cosf(angle), sinf(angle));
+    }
+    const GContour ctr = { 101, star, true };
+    const GPaint paint(GColor::MakeARGB(1, 0, 0, 1));
+
+    bool same = true;
+    for (int frame = 0; frame < 400; ++frame) {
+        const float tx = 32 + 9.37f * sinf(frame * 0.7f);
+        const float ty = 32 + 5.11f * cosf(frame * 1.3f);
+        GCanvas* canvases[2] = { cached.canvas(), plain.canvas() };
+        for (GCanvas* canvas : canvases) {
+            canvas->clear(GColor::MakeARGB(0, 0, 0, 0));
+            canvas->save();
+            canvas->translate(tx, ty);
+            canvas->rotate(0.3f);
+            canvas->scale(20.3f, 19.7f);
+            canvas->drawContours(&ctr, 1, paint);
+            canvas->restore();
+        }
+        same &= bitmaps_eq(cached.bitmap(), plain.bitmap());
+    }
+    stats->expectTrue(same, "geometry_cache_pan");
+}
+
+// Winding of the closed polygons around (x, y), by casting a ray towards +x over every edge.
+static int brute_winding(const std::vector<std::vector<GPoint>>& polys, float x, float y) {
+    int winding = 0;
+    for (const std::vector<GPoint>& poly : polys) {
+        for (size_t i = 0; i < poly.size(); ++i) {
+            GPoint a = poly[i], b = poly[(i + 1) % poly.size()];
+            const int dir = b.fY > a.fY ? 1 : -1;
+            if (b.fY < a.fY) {
+                std::swap(a, b);
+            }
+            if (y >= a.fY && y < b.fY && a.fX + (y - a.fY) * (b.fX - a.fX) / (b.fY - a.fY) > x) {
+                winding += dir;
+            }
+        }
+    }
+    return winding;
+}
+
+// A comb: one edge spanning the whole height next to many short teeth, plus a rect wound the
+// same way (winding 2) and one wound backwards (a hole for kWinding).
+static void test_path_contains(GTestStats* stats) {
+    std::vector<std::vector<GPoint>> polys(3);
+    polys[0].push_back(GPoint::Make(0, 0));
+    polys[0].push_back(GPoint::Make(0, 100));
+    for (int i = 0; i <= 40; ++i) {
+        polys[0].push_back(GPoint::Make(i & 1 ? 20 : 40, 100 - i * 2.5f));
+    }
+    polys[1] = { GPoint::Make(10, 30), GPoint::Make(10, 70), GPoint::Make(30, 70),
+                 GPoint::Make(30, 30) };
+    polys[2] = { GPoint::Make(5, 80), GPoint::Make(15, 80), GPoint::Make(15, 90),
+                 GPoint::Make(5, 90) };
+
+    CurvePath path;
+    for (const std::vector<GPoint>& poly : polys) {
+        path.moveTo(poly[0]);
+        for (size_t i = 1; i < poly.size(); ++i) {
+            path.lineTo(poly[i]);
+        }
+    }
+
+    const FillRule rules[] = {
+        FillRule::kWinding, FillRule::kEvenOdd, FillRule::kInverseWinding,
+        FillRule::kInverseEvenOdd,
+    };
+    bool ok = true;
+    for (float y = -5.13f; y < 105; y += 0.71f) {
+        for (float x = -5.37f; x < 45; x += 0.83f) {
+            const int winding = brute_winding(polys, x, y);
+            for (FillRule rule : rules) {
+                ok &= path.contains(x, y, rule) == fill_rule_inside(winding, rule);
+            }
+        }
+    }
+    stats->expectTrue(ok, "path_contains_comb");
+    stats->expectTrue(path.contains(20, 50, FillRule::kWinding) &&
+                      !path.contains(20, 50, FillRule::kEvenOdd), "path_contains_even_odd");
+    stats->expectTrue(!path.contains(10, 85, FillRule::kWinding) &&
+                      path.contains(10, 85, FillRule::kInverseWinding), "path_contains_hole");
+}
+
+static void rect_pts(GPoint pts[4], float l, float t, float r, float b) {
+    pts[0].set(l, t);
+    pts[1].set(r, t);
+    pts[2].set(r, b);
+    pts[3].set(l, b);
+}
+
+// Two overlapping rects wound the same way: the overlap has winding 2, the rest of each rect 1.
+static void test_fill_rules(GTestStats* stats) {
+    GSurface surface(20, 20);
+    GCanvas* canvas = surface.canvas();
+    const GPixel blue = GPixel_PackARGB(0xFF, 0, 0, 0xFF);
+    const GPaint paint(GColor::MakeARGB(1, 0, 0, 1));
+
+    GPoint a[4], b[4];
+    rect_pts(a, 2, 2, 12, 12);
+    rect_pts(b, 8, 8, 18, 18);
+    const GContour ctrs[] = { { 4, a, true }, { 4, b, true } };
+
+    const struct {
+        FillRule    fRule;
+        bool        fOverlap, fSingle, fOutside;
+        const char* fMsg;
+    } recs[] = {
+        { FillRule::kWinding,         true,  true,  false, "fill_rule_winding" },
+        { FillRule::kEvenOdd,         false, true,  false, "fill_rule_even_odd" },
+        { FillRule::kInverseWinding,  false, false, true,  "fill_rule_inverse_winding" },
+        { FillRule::kInverseEvenOdd,  true,  false, true,  "fill_rule_inverse_even_odd" },
+    };
+    for (int i = 0; i < GARRAY_COUNT(recs); ++i) {
+        canvas->clear(GColor::MakeARGB(0, 0, 0, 0));
+        canvas_draw_contours(canvas, ctrs, 2, paint, recs[i].fRule);
+        bool ok = true;
+        for (int y = 0; y < 20; ++y) {
+            for (int x = 0; x < 20; ++x) {
+                const int winding = (x >= 2 && x < 12 && y >= 2 && y < 12) +
+                                    (x >= 8 && x < 18 && y >= 8 && y < 18);
+                const bool inside = winding == 2 ? recs[i].fOverlap :
+                                    winding == 1 ? recs[i].fSingle : recs[i].fOutside;
+                ok &= *surface.bitmap().getAddr(x, y) == (inside ? blue : 0);
+            }
+        }
+        stats->expectTrue(ok, recs[i].fMsg);
+    }
+
+    // an inverse fill of contours entirely off the canvas covers every row
+    canvas->clear(GColor::MakeARGB(0, 0, 0, 0));
+    rect_pts(a, -10, 30, -5, 40);
+    canvas_draw_contours(canvas, ctrs, 1, paint, FillRule::kInverseWinding);
+    stats->expectTrue(is_filled_with(surface.bitmap(), blue), "fill_rule_inverse_offscreen");
+
+    // the path's own rule is used by canvas_draw_path
+    canvas->clear(GColor::MakeARGB(0, 0, 0, 0));
+    CurvePath path;
+    path.moveTo(GPoint::Make(2, 2)).lineTo(GPoint::Make(18, 2)).lineTo(GPoint::Make(18, 18))
+        .lineTo(GPoint::Make(2, 18));
+    path.moveTo(GPoint::Make(6, 6)).lineTo(GPoint::Make(14, 6)).lineTo(GPoint::Make(14, 14))
+        .lineTo(GPoint::Make(6, 14));
+    path.setFillRule(FillRule::kEvenOdd);
+    canvas_draw_path(canvas, path, paint);
+    stats->expectTrue(*surface.bitmap().getAddr(3, 3) == blue &&
+                      *surface.bitmap().getAddr(10, 10) == 0 &&
+                      *surface.bitmap().getAddr(0, 0) == 0, "fill_rule_path_even_odd");
+}
+
+// Rects under a scale/translate CTM skip the polygon filler; they must still land on exactly
+// the pixels it would fill, batched or one at a time, flipped or not.
+static void test_rects_match_poly(GTestStats* stats) {
+    const struct {
+        float fSX, fSY, fTX, fTY;
+    } ctms[] = {
+        {     1,     1,     0,     0 },
+        {  1.7f, 0.61f,  3.3f, -2.1f },
+        {    -1,     1,    40,     0 },
+        { 0.83f, -1.3f, -1.6f,    31 },
+    };
+    GShader* shader = GShader::LinearGradient({0, 0}, {40, 30}, {1, 1, 0, 0}, {0.5f, 0, 0, 1});
+    GRandom rand;
+
+    for (int i = 0; i < GARRAY_COUNT(ctms); ++i) {
+        GMatrix scale, translate, ctm;
+        scale.setScale(ctms[i].fSX, ctms[i].fSY);
+        translate.setTranslate(ctms[i].fTX, ctms[i].fTY);
+        ctm.setConcat(translate, scale);
+
+        for (int p = 0; p < 3; ++p) {
+            GPaint paint(GColor::MakeARGB(p == 0 ? 1 : 0.6f, 0.2f, 0.7f, 0.4f));
+            if (p == 2) {
+                paint.setShader(shader);
+            }
+            GRect rects[20];
+            for (int r = 0; r < 20; ++r) {
+                const float x = rand.nextF() * 50 - 8, y = rand.nextF() * 40 - 8;
+                rects[r] = GRect::MakeXYWH(x, y, rand.nextF() * 20, rand.nextF() * 15);
+            }
+
+            GSurface batched(40, 30), single(40, 30), poly(40, 30);
+            GCanvas* canvases[] = { batched.canvas(), single.canvas(), poly.canvas() };
+            for (GCanvas* canvas : canvases) {
+                canvas->clear(GColor::MakeARGB(1, 1, 1, 1));
+                canvas->save();
+                canvas->concat(ctm);
+            }
+            canvas_draw_rects(batched.canvas(), rects, 20, paint);
+            for (int r = 0; r < 20; ++r) {
+                GPoint pts[4];
+                rect_pts(pts, rects[r].left(), rects[r].top(), rects[r].right(), rects[r].bottom());
+                single.canvas()->drawRect(rects[r], paint);
+                poly.canvas()->drawConvexPolygon(pts, 4, paint);
+            }
+            stats->expectTrue(bitmaps_eq(batched.bitmap(), poly.bitmap()), "rects_batch_match_poly");
+            stats->expectTrue(bitmaps_eq(single.bitmap(), poly.bitmap()), "rects_match_poly");
+        }
+    }
+    delete shader;
+}
+
+// Pans a circle path over fractional offsets with the mask cache on. The cache snaps the offset to
+// 1/4 pixel, so pixels may only differ from the uncached fill where the outline passes within
+// the snap distance (plus flattening error) of their center.
+static void test_mask_cache(GTestStats* stats) {
+    GSurface cached(48, 48), plain(48, 48);
+    canvas_set_mask_cache(cached.canvas(), 16);
+
+    const float k = 0.5523f;
+    CurvePath circle;
+    circle.moveTo(GPoint::Make(1, 0));
+    circle.cubicTo(GPoint::Make(1, k), GPoint::Make(k, 1), GPoint::Make(0, 1));
+    circle.cubicTo(GPoint::Make(-k, 1), GPoint::Make(-1, k), GPoint::Make(-1, 0));
+    circle.cubicTo(GPoint::Make(-1, -k), GPoint::Make(-k, -1), GPoint::Make(0, -1));
+    circle.cubicTo(GPoint::Make(k, -1), GPoint::Make(1, -k), GPoint::Make(1, 0));
+    const GPaint paint(GColor::MakeARGB(1, 0, 0, 1));
+
+    bool close = true;
+    int total_diff = 0;
+    for (int frame = 0; frame < 200; ++frame) {
+        const float tx = 24 + 7.3f * sinf(frame * 0.37f);
+        const float ty = 24 + 6.1f * cosf(frame * 0.53f);
+        GCanvas* canvases[2] = { cached.canvas(), plain.canvas() };
+        for (GCanvas* canvas : canvases) {
+            canvas->clear(GColor::MakeARGB(0, 0, 0, 0));
+            canvas->save();
+            canvas->translate(tx, ty);
+            canvas->scale(12, 12);
+            canvas_draw_path(canvas, circle, paint);
+            canvas->restore();
+        }
+        for (int y = 0; y < 48; ++y) {
+            for (int x = 0; x < 48; ++x) {
+                if (*cached.bitmap().getAddr(x, y) != *plain.bitmap().getAddr(x, y)) {
+                    total_diff += 1;
+                    close &= fabsf(hypotf(x + 0.5f - tx, y + 0.5f - ty) - 12) < 0.5f;
+                }
+            }
+        }
+    }
+    stats->expectTrue(close, "mask_cache_near_outline");
+    // about 75 pixels lie on the outline each frame; snapping moves only a few of them
+    stats->expectTrue(total_diff < 200 * 8, "mask_cache_few_diffs");
+
+    // offsets already on the 1/4 pixel grid are not moved; only pixels whose center sits exactly
+    // on the outline may go either way
+    bool on_grid = true;
+    for (int frame = 0; frame < 32; ++frame) {
+        const float tx = 20 + (frame % 8) * 0.25f, ty = 22 + (frame / 8) * 0.75f;
+        GCanvas* canvases[2] = { cached.canvas(), plain.canvas() };
+        for (GCanvas* canvas : canvases) {
+            canvas->clear(GColor::MakeARGB(0, 0, 0, 0));
+            canvas->save();
+            canvas->translate(tx, ty);
+            canvas->scale(12, 12);
+            canvas_draw_path(canvas, circle, paint);
+            canvas->restore();
+        }
+        for (int y = 0; y < 48; ++y) {
+            for (int x = 0; x < 48; ++x) {
+                if (*cached.bitmap().getAddr(x, y) != *plain.bitmap().getAddr(x, y)) {
+                    on_grid &= fabsf(hypotf(x + 0.5f - tx, y + 0.5f - ty) - 12) < 0.01f;
+                }
+            }
+        }
+    }
+    stats->expectTrue(on_grid, "mask_cache_grid");
+}
+
+// opaque pixels that differ at every (x, y) of a w x h bitmap
+static GBitmap make_ramp_bitmap(std::vector<GPixel>* storage, int w, int h) {
+    storage->resize(w * h);
+    for (int y = 0; y < h; ++y) {
+        for (int x = 0; x < w; ++x) {
+            (*storage)[y * w + x] = raw_pixel(0xFF, x * 30, y * 40, 0x80);
+        }
+    }
+    GBitmap bitmap;
+    bitmap.fWidth = w;
+    bitmap.fHeight = h;
+    bitmap.fRowBytes = w * sizeof(GPixel);
+    bitmap.fPixels = storage->data();
+    return bitmap;
+}
+
+static void test_atlas(GTestStats* stats) {
+    std::vector<GPixel> storage;
+    const GBitmap atlas = make_ramp_bitmap(&storage, 8, 4);
+    const GIRect src[2] = { GIRect::MakeLTRB(0, 0, 4, 4), GIRect::MakeLTRB(4, 0, 8, 4) };
+    GSurface surface(20, 12);
+    GCanvas* canvas = surface.canvas();
+    const GBitmap& dst = surface.bitmap();
+
+    // translated sprites are copied texel for texel
+    GMatrix xforms[2];
+    xforms[0].setTranslate(2, 3);
+    xforms[1].setTranslate(10, 3);
+    canvas->clear(GColor::MakeARGB(0, 0, 0, 0));
+    canvas_draw_atlas(canvas, atlas, xforms, src, nullptr, 2, GPaint());
+    bool ok = true;
+    for (int y = 0; y < 12; ++y) {
+        for (int x = 0; x < 20; ++x) {
+            GPixel expected = 0;
+            if (y >= 3 && y < 7 && x >= 2 && x < 6) {
+                expected = *atlas.getAddr(x - 2, y - 3);
+            } else if (y >= 3 && y < 7 && x >= 10 && x < 14) {
+                expected = *atlas.getAddr(x - 10 + 4, y - 3);
+            }
+            ok &= *dst.getAddr(x, y) == expected;
+        }
+    }
+    stats->expectTrue(ok, "atlas_translate");
+
+    // a scaled sprite samples the nearest texel, tinted by its color
+    xforms[0].setTranslate(1, 1);
+    xforms[0].preScale(2, 2);
+    const GColor red = GColor::MakeARGB(1, 1, 0, 0);
+    canvas->clear(GColor::MakeARGB(0, 0, 0, 0));
+    canvas_draw_atlas(canvas, atlas, xforms, &src[1], &red, 1, GPaint());
+    ok = true;
+    for (int y = 0; y < 12; ++y) {
+        for (int x = 0; x < 20; ++x) {
+            GPixel expected = 0;
+            if (y >= 1 && y < 9 && x >= 1 && x < 9) {
+                expected = raw_pixel(0xFF, GPixel_GetR(*atlas.getAddr(4 + (x - 1) / 2, 0)), 0, 0);
+            }
+            ok &= *dst.getAddr(x, y) == expected;
+        }
+    }
+    stats->expectTrue(ok, "atlas_scale_tint");
+
+    // src rects are clipped to the atlas, and later sprites land on top
+    const GIRect wide[2] = { GIRect::MakeLTRB(-4, 0, 4, 2), GIRect::MakeLTRB(4, 2, 8, 4) };
+    xforms[0].setTranslate(0, 0);
+    xforms[1].setTranslate(2, 0);
+    canvas->clear(GColor::MakeARGB(0, 0, 0, 0));
+    canvas_draw_atlas(canvas, atlas, xforms, wide, nullptr, 2, GPaint());
+    stats->expectTrue(*dst.getAddr(0, 0) == *atlas.getAddr(0, 0) &&
+                      *dst.getAddr(1, 1) == *atlas.getAddr(1, 1) &&
+                      *dst.getAddr(2, 0) == *atlas.getAddr(4, 2) &&
+                      *dst.getAddr(5, 1) == *atlas.getAddr(7, 3) &&
+                      *dst.getAddr(6, 0) == 0 && *dst.getAddr(0, 2) == 0, "atlas_clip_order");
+}
+
+// source column (or row) a nine patch with a 2 px fixed border on each side of a 2 px center
+// samples at device offset d, for a dst 10 px wide
+static int nine_src(int d) {
+    return d < 2 ? d : d >= 8 ? d - 4 : 2 + (int)((d - 2 + 0.5f) / 3);
+}
+
+static void test_nine_patch(GTestStats* stats) {
+    std::vector<GPixel> storage;
+    const GBitmap src = make_ramp_bitmap(&storage, 6, 6);
+    GSurface surface(12, 12);
+    GCanvas* canvas = surface.canvas();
+    const GBitmap& dst = surface.bitmap();
+    const GIRect center = GIRect::MakeLTRB(2, 2, 4, 4);
+
+    canvas->clear(GColor::MakeARGB(0, 0, 0, 0));
+    canvas_draw_bitmap_nine(canvas, src, center, GRect::MakeXYWH(1, 1, 10, 10), GPaint());
+    bool ok = true;
+    for (int y = 0; y < 12; ++y) {
+        for (int x = 0; x < 12; ++x) {
+            GPixel expected = 0;
+            if (x >= 1 && x < 11 && y >= 1 && y < 11) {
+                expected = *src.getAddr(nine_src(x - 1), nine_src(y - 1));
+            }
+            ok &= *dst.getAddr(x, y) == expected;
+        }
+    }
+    stats->expectTrue(ok, "nine_patch_stretch");
+
+    // flipped, the cells go through the sprite path and land mirrored
+    GSurface flipped(12, 12);
+    flipped.canvas()->clear(GColor::MakeARGB(0, 0, 0, 0));
+    flipped.canvas()->translate(12, 0);
+    flipped.canvas()->scale(-1, 1);
+    canvas_draw_bitmap_nine(flipped.canvas(), src, center, GRect::MakeXYWH(1, 1, 10, 10), GPaint());
+    ok = true;
+    for (int y = 0; y < 12; ++y) {
+        for (int x = 0; x < 12; ++x) {
+            ok &= *flipped.bitmap().getAddr(11 - x, y) == *dst.getAddr(x, y);
+        }
+    }
+    stats->expectTrue(ok, "nine_patch_flipped");
+
+    // too small for the borders: the fixed columns shrink together, 4 px of border into 2
+    canvas->clear(GColor::MakeARGB(0, 0, 0, 0));
+    const int x_divs[] = { 2, 4 };
+    canvas_draw_bitmap_lattice(canvas, src, x_divs, 2, nullptr, 0, GRect::MakeXYWH(0, 0, 2, 6),
+                               GPaint());
+    stats->expectTrue(*dst.getAddr(0, 0) == *src.getAddr(1, 0) &&
+                      *dst.getAddr(1, 5) == *src.getAddr(5, 5) &&
+                      *dst.getAddr(2, 0) == 0, "lattice_shrink");
+
+    // divs out of order draw nothing
+    canvas->clear(GColor::MakeARGB(0, 0, 0, 0));
+    const int bad_divs[] = { 4, 2 };
+    canvas_draw_bitmap_lattice(canvas, src, bad_divs, 2, nullptr, 0, GRect::MakeWH(12, 12),
+                               GPaint());
+    stats->expectTrue(is_filled_with(dst, 0), "lattice_bad_divs");
+}
+
+// Red and blue rects overlap inside a half transparent layer: the overlap shows only blue, at
+// the same half opacity as the rest of the blue rect.
+static void test_save_layer(GTestStats* stats) {
+    GSurface surface(20, 20);
+    GCanvas* canvas = surface.canvas();
+    const GBitmap& dst = surface.bitmap();
+    const GPixel white = raw_pixel(0xFF, 0xFF, 0xFF, 0xFF);
+    const unsigned half = unit_to_byte(0.5f);
+    const GPixel faded_red = blend_srcover(scale_pixel(raw_pixel(0xFF, 0xFF, 0, 0), half), white);
+    const GPixel faded_blue = blend_srcover(scale_pixel(raw_pixel(0xFF, 0, 0, 0xFF), half), white);
+
+    canvas->clear(GColor::MakeARGB(1, 1, 1, 1));
+    GPaint layer_paint;
+    layer_paint.setAlpha(0.5f);
+    canvas_save_layer(canvas, nullptr, layer_paint);
+    canvas->fillRect(GRect::MakeLTRB(2, 2, 12, 12), GColor::MakeARGB(1, 1, 0, 0));
+    canvas->fillRect(GRect::MakeLTRB(8, 8, 18, 18), GColor::MakeARGB(1, 0, 0, 1));
+    stats->expectTrue(is_filled_with(dst, white), "save_layer_offscreen");
+    canvas->restore();
+    stats->expectTrue(*dst.getAddr(4, 4) == faded_red && *dst.getAddr(10, 10) == faded_blue &&
+                      *dst.getAddr(15, 15) == faded_blue && *dst.getAddr(0, 0) == white,
+                      "save_layer_group_alpha");
+
+    // bounds clip the layer, and draws after the restore go straight to the canvas
+    canvas->clear(GColor::MakeARGB(1, 1, 1, 1));
+    const GRect bounds = GRect::MakeLTRB(0, 0, 10, 20);
+    canvas_save_layer(canvas, &bounds, GPaint());
+    canvas->fillRect(GRect::MakeLTRB(5, 0, 15, 5), GColor::MakeARGB(1, 1, 0, 0));
+    canvas->restore();
+    canvas->fillRect(GRect::MakeLTRB(5, 10, 15, 15), GColor::MakeARGB(1, 0, 0, 1));
+    const GPixel red = raw_pixel(0xFF, 0xFF, 0, 0), blue = raw_pixel(0xFF, 0, 0, 0xFF);
+    stats->expectTrue(*dst.getAddr(9, 2) == red && *dst.getAddr(10, 2) == white &&
+                      *dst.getAddr(14, 12) == blue, "save_layer_bounds");
+
+    // nested layers each composite into their parent, and the CTM is restored with them
+    canvas->clear(GColor::MakeARGB(1, 1, 1, 1));
+    canvas_save_layer(canvas, nullptr, layer_paint);
+    canvas->translate(5, 0);
+    canvas_save_layer(canvas, nullptr, GPaint());
+    canvas->fillRect(GRect::MakeLTRB(0, 0, 5, 5), GColor::MakeARGB(1, 1, 0, 0));
+    canvas->restore();
+    canvas->fillRect(GRect::MakeLTRB(0, 5, 5, 10), GColor::MakeARGB(1, 0, 0, 1));
+    canvas->restore();
+    canvas->fillRect(GRect::MakeLTRB(0, 0, 1, 1), GColor::MakeARGB(1, 0, 0, 1));
+    stats->expectTrue(*dst.getAddr(7, 2) == faded_red && *dst.getAddr(7, 7) == faded_blue &&
+                      *dst.getAddr(2, 2) == white && *dst.getAddr(0, 0) == blue,
+                      "save_layer_nested");
+}
+
+// Solid green, counting the rows it is asked for.
+class CountingShader : public GShader {
+public:
+    int fRows = 0;
+
+    bool setContext(const GMatrix&, float) override { return true; }
+    void shadeRow(int x, int y, int count, GPixel row[]) override {
+        fRows += 1;
+        for (int i = 0; i < count; ++i) {
+            row[i] = GPixel_PackARGB(0xFF, 0, 0xFF, 0);
+        }
+    }
+};
+
+// A frame mixing every recorded draw kind with clears, CTM changes, a layer and an atlas,
+// which is never recorded. Only rand decides what is drawn.
+static void draw_mixed_frame(GCanvas* canvas, GRandom& rand, GShader* shader,
+                             const GBitmap& atlas) {
+    canvas->clear(GColor::MakeARGB(0.5f, 1, 1, 1));
+    for (int i = 0; i < 60; ++i) {
+        const float x = rand.nextF() * 40 - 5, y = rand.nextF() * 30 - 5;
+        const float w = rand.nextF() * 25, h = rand.nextF() * 20;
+        GPaint paint(GColor::MakeARGB(rand.nextF() < 0.5f ? 1 : rand.nextF(),
+                                      rand.nextF(), rand.nextF(), rand.nextF()));
+        if (i == 20) {
+            canvas->clear(GColor::MakeARGB(1, 0, 0.3f, 0));
+        }
+        if (i == 30) {
+            const GMatrix xform;
+            const GIRect src = GIRect::MakeLTRB(0, 0, 8, 4);
+            canvas_draw_atlas(canvas, atlas, &xform, &src, nullptr, 1, GPaint());
+        }
+        if (i == 40) {
+            GPaint layer_paint;
+            layer_paint.setAlpha(0.5f);
+            canvas_save_layer(canvas, nullptr, layer_paint);
+        }
+        if (i == 45) {
+            canvas->restore();
+        }
+        switch (rand.nextU() % 6) {
+            case 0:
+                canvas->drawRect(GRect::MakeXYWH(x, y, w, h), paint);
+                break;
+            case 1:
+                paint.setShader(shader);
+                canvas->drawRect(GRect::MakeXYWH(x, y, w, h), paint);
+                break;
+            case 2: {
+                const GPoint pts[] = {
+                    GPoint::Make(x, y), GPoint::Make(x + w, y + h / 2), GPoint::Make(x, y + h)
+                };
+                canvas->drawConvexPolygon(pts, 3, paint);
+                break;
+            }
+            case 3: {
+                GPoint pts[8];
+                rect_pts(pts, x, y, x + w, y + h);
+                rect_pts(pts + 4, x + w / 4, y + h / 4, x + w / 2, y + h / 2);
+                const GContour ctrs[] = { { 4, pts, true }, { 4, pts + 4, true } };
+                canvas_draw_contours(canvas, ctrs, 2, paint, FillRule::kEvenOdd);
+                break;
+            }
+            case 4: {
+                CurvePath path;
+                path.moveTo(GPoint::Make(x, y)).quadTo(GPoint::Make(x + w, y),
+                                                       GPoint::Make(x + w, y + h));
+                canvas_draw_path(canvas, path, paint);
+                break;
+            }
+            case 5:
+                canvas->save();
+                canvas->translate(x, y);
+                canvas->rotate(rand.nextF());
+                canvas->scale(1.5f, 0.75f);
+                canvas->drawRect(GRect::MakeWH(w, h), paint);
+                canvas->restore();
+                break;
+        }
+    }
+}
+
+// Deferred frames match immediate ones, and draws hidden behind later opaque rects never
+// reach the shader.
+static void test_deferred(GTestStats* stats) {
+    std::vector<GPixel> storage;
+    const GBitmap atlas = make_ramp_bitmap(&storage, 8, 4);
+    GShader* shader = GShader::LinearGradient({0, 0}, {40, 0}, {1, 0, 0, 1}, {0.4f, 1, 0, 0});
+
+    bool ok = true;
+    for (int seed = 1; seed <= 20; ++seed) {
+        GSurface immediate(40, 30), deferred(40, 30);
+        GRandom rand0(seed), rand1(seed);
+        draw_mixed_frame(immediate.canvas(), rand0, shader, atlas);
+        canvas_begin_deferred(deferred.canvas());
+        draw_mixed_frame(deferred.canvas(), rand1, shader, atlas);
+        canvas_end_deferred(deferred.canvas());
+        ok &= bitmaps_eq(immediate.bitmap(), deferred.bitmap());
+    }
+    stats->expectTrue(ok, "deferred_matches_immediate");
+    delete shader;
+
+    GSurface surface(20, 20);
+    GCanvas* canvas = surface.canvas();
+    const GPixel red = GPixel_PackARGB(0xFF, 0xFF, 0, 0);
+    CountingShader counter;
+    GPaint counted;
+    counted.setShader(&counter);
+
+    canvas_begin_deferred(canvas);
+    canvas->drawRect(GRect::MakeLTRB(2, 2, 10, 10), counted);
+    canvas->fillRect(GRect::MakeLTRB(0, 0, 20, 20), GColor::MakeARGB(1, 1, 0, 0));
+    canvas_flush_deferred(canvas);
+    stats->expectTrue(counter.fRows == 0 && is_filled_with(surface.bitmap(), red),
+                      "deferred_culls_hidden");
+
+    // partly uncovered, or under a translucent rect: still drawn
+    canvas->drawRect(GRect::MakeLTRB(15, 15, 25, 25), counted);
+    canvas->fillRect(GRect::MakeLTRB(0, 0, 18, 18), GColor::MakeARGB(1, 1, 0, 0));
+    canvas->drawRect(GRect::MakeLTRB(2, 2, 10, 10), counted);
+    canvas->fillRect(GRect::MakeLTRB(0, 0, 12, 12), GColor::MakeARGB(0.5f, 1, 0, 0));
+    canvas_end_deferred(canvas);
+    stats->expectTrue(counter.fRows == 5 + 8, "deferred_keeps_visible");
+
+    // no longer deferring: draws land at once
+    canvas->drawRect(GRect::MakeLTRB(0, 0, 4, 4), counted);
+    stats->expectTrue(counter.fRows == 13 + 4 &&
+                      *surface.bitmap().getAddr(1, 1) == GPixel_PackARGB(0xFF, 0, 0xFF, 0),
+                      "deferred_ended");
+}
+
+static int max_channel_diff(const GBitmap& a, const GBitmap& b) {
+    int diff = 0;
+    for (int y = 0; y < a.height(); ++y) {
+        for (int x = 0; x < a.width(); ++x) {
+            const GPixel pa = *a.getAddr(x, y), pb = *b.getAddr(x, y);
+            for (int shift = 0; shift < 32; shift += 8) {
+                diff = std::max(diff, abs((int)((pa >> shift) & 0xFF) - (int)((pb >> shift) & 0xFF)));
+            }
+        }
+    }
+    return diff;
+}
+
+static void draw_rects_scene(GCanvas* canvas) {
+    canvas->clear(GColor::MakeARGB(1, 1, 1, 1));
+    canvas->fillRect(GRect::MakeLTRB(4, 4, 40, 24), GColor::MakeARGB(0.5f, 1, 0, 0));
+    canvas->fillRect(GRect::MakeLTRB(10, 8, 30, 36), GColor::MakeARGB(0.3f, 0, 0, 1));
+    canvas->fillRect(GRect::MakeLTRB(20, 2, 46, 30), GColor::MakeARGB(0.7f, 0.2f, 0.8f, 0.1f));
+    canvas->fillRect(GRect::MakeLTRB(0, 30, 48, 40), GColor::MakeARGB(1, 0, 0.5f, 0.5f));
+}
+
+static void draw_gradient_scene(GCanvas* canvas) {
+    GShader* shader = GShader::LinearGradient({4, 0}, {44, 0}, {1, 1, 0, 0}, {0.4f, 0, 0.6f, 1});
+    GPaint paint(shader);
+    canvas->clear(GColor::MakeARGB(1, 0.2f, 0.2f, 0.2f));
+    canvas->drawRect(GRect::MakeLTRB(0, 0, 48, 20), paint);
+    paint.setAlpha(0.6f);
+    canvas->drawRect(GRect::MakeLTRB(0, 20, 48, 40), paint);
+    delete shader;
+}
+
+static void draw_mesh_scene(GCanvas* canvas) {
+    std::vector<GPixel> storage;
+    const GBitmap tex = make_ramp_bitmap(&storage, 8, 4);
+    GShader* shader = GShader::FromBitmap(tex, GMatrix());
+    canvas->clear(GColor::MakeARGB(1, 1, 1, 1));
+
+    const GPoint left[] = { {2, 2}, {22, 6}, {20, 38}, {4, 34} };
+    const GPoint right[] = { {26, 2}, {46, 6}, {44, 38}, {28, 34} };
+    const int indices[] = { 0, 1, 2, 0, 2, 3 };
+    const GColor colors[] = { {1, 1, 0, 0}, {0.5f, 0, 1, 0}, {1, 0, 0, 1}, {0.8f, 1, 1, 0} };
+    const GPoint tex_pts[] = { {0, 0}, {8, 0}, {8, 4}, {0, 4} };
+    canvas->drawMesh(2, left, indices, colors, nullptr, GPaint());
+    canvas->drawMesh(2, right, indices, colors, tex_pts, GPaint(shader));
+    delete shader;
+}
+
+// The float canvas rasterizes like GCanvas::Create and only blends at higher precision, so once
+// quantized it lands within one step of the 8-bit result. Shaded draws do not overlap: stacked on
+// each other, the 8-bit side's own rounding can drift by more than a step.
+static void test_float_canvas(GTestStats* stats) {
+    void (*scenes[])(GCanvas*) = { draw_rects_scene, draw_gradient_scene, draw_mesh_scene };
+    const FloatFormat formats[] = { FloatFormat::kF32, FloatFormat::kF16 };
+
+    for (int i = 0; i < GARRAY_COUNT(scenes); ++i) {
+        GSurface expected(48, 40);
+        scenes[i](expected.canvas());
+        for (FloatFormat format : formats) {
+            FloatBitmap dst(48, 40, format);
+            GCanvas* canvas = create_float_canvas(dst);
+            scenes[i](canvas);
+            delete canvas;
+
+            GSurface actual(48, 40);
+            dst.to_bitmap(actual.bitmap());
+            stats->expectTrue(max_channel_diff(expected.bitmap(), actual.bitmap()) <= 1,
+                              format == FloatFormat::kF32 ? "float_canvas_f32" : "float_canvas_f16");
+        }
+    }
+}
+
+// Every finite half survives half -> float -> half, and rows of them survive an F16 store and
+// load unchanged.
+static void test_f16_round_trip(GTestStats* stats) {
+    bool ok = true;
+    std::vector<float> halves;
+    for (uint32_t h = 0; h < 0x10000; ++h) {
+        if ((h & 0x7C00) == 0x7C00) {
+            continue;   // inf and nan
+        }
+        halves.push_back(half_to_float((uint16_t)h));
+        ok &= float_to_half(halves.back()) == h;
+    }
+    stats->expectTrue(ok, "f16_half_float_half");
+    // halfway between two halves rounds to the even one
+    stats->expectTrue(float_to_half(1 + 1.0f / 2048) == 0x3C00 &&
+                      float_to_half(1 + 3.0f / 2048) == 0x3C02 &&
+                      float_to_half(1 + 1.5f / 2048) == 0x3C01, "f16_round_to_even");
+
+    std::vector<PixelF> row(halves.size() / 4);
+    memcpy(row.data(), halves.data(), row.size() * sizeof(PixelF));
+    FloatBitmap bitmap((int)row.size(), 1, FloatFormat::kF16);
+    bitmap.store_row(0, 0, (int)row.size(), row.data());
+    std::vector<PixelF> loaded(row.size());
+    bitmap.load_row(0, 0, (int)row.size(), loaded.data());
+    stats->expectTrue(!memcmp(row.data(), loaded.data(), row.size() * sizeof(PixelF)),
+                      "f16_store_load");
+}
+
+static FormatBitmap make_format_bitmap(std::vector<uint32_t>* storage, int w, int h,
+                                       PixelFormat format) {
+    const size_t rowBytes = w * bytes_per_pixel(format);
+    storage->assign((rowBytes * h + 3) / 4, 0);
+    FormatBitmap bitmap = { w, h, rowBytes, storage->data(), format };
+    return bitmap;
+}
+
+static GPixel swap_red_blue(GPixel pix) {
+    return raw_pixel(GPixel_GetA(pix), GPixel_GetB(pix), GPixel_GetG(pix), GPixel_GetR(pix));
+}
+
+static void test_bgra_canvas(GTestStats* stats) {
+    void (*scenes[])(GCanvas*) = { draw_rects_scene, draw_gradient_scene, draw_mesh_scene };
+
+    for (int i = 0; i < GARRAY_COUNT(scenes); ++i) {
+        GSurface expected(48, 40);
+        scenes[i](expected.canvas());
+
+        std::vector<uint32_t> storage;
+        const FormatBitmap dst = make_format_bitmap(&storage, 48, 40, PixelFormat::kBGRA_8888);
+        GCanvas* canvas = create_format_canvas(dst);
+        scenes[i](canvas);
+        delete canvas;
+
+        bool ok = true;
+        for (int y = 0; y < 40; ++y) {
+            for (int x = 0; x < 48; ++x) {
+                ok &= *(const GPixel*)dst.getAddr(x, y) ==
+                      swap_red_blue(*expected.bitmap().getAddr(x, y));
+            }
+        }
+        stats->expectTrue(ok, "bgra_canvas");
+    }
+}
+
+// One draw over an opaque background, so each 565 pixel is either the background or the draw's
+// premultiplied source (read back from a transparent ARGB canvas) blended over the expanded
+// background.
+static void test_565_canvas(GTestStats* stats) {
+    GShader* shader = GShader::LinearGradient({0, 0}, {32, 0}, {1, 1, 0, 0}, {0.2f, 0, 0.6f, 1});
+    GPaint opaque(GColor::MakeARGB(1, 0.3f, 0.7f, 0.9f));
+    GPaint translucent(GColor::MakeARGB(0.4f, 1, 0.5f, 0));
+    GPaint shaded(shader);
+    const GPaint* paints[] = { &opaque, &translucent, &shaded };
+    const char* names[] = { "565_opaque", "565_translucent", "565_shaded" };
+    const GColor background = GColor::MakeARGB(1, 0.1f, 0.6f, 0.3f);
+
+    for (int i = 0; i < GARRAY_COUNT(paints); ++i) {
+        GSurface src(32, 16);
+        src.canvas()->clear(GColor::MakeARGB(0, 0, 0, 0));
+        src.canvas()->drawRect(GRect::MakeLTRB(3, 2, 29, 14), *paints[i]);
+        GSurface bg(1, 1);
+        bg.canvas()->clear(background);
+        const uint16_t bg565 = pack_565(*bg.bitmap().getAddr(0, 0));
+
+        std::vector<uint32_t> storage;
+        const FormatBitmap dst = make_format_bitmap(&storage, 32, 16, PixelFormat::kRGB_565);
+        GCanvas* canvas = create_format_canvas(dst);
+        canvas->clear(background);
+        canvas->drawRect(GRect::MakeLTRB(3, 2, 29, 14), *paints[i]);
+        delete canvas;
+
+        bool ok = true;
+        for (int y = 0; y < 16; ++y) {
+            for (int x = 0; x < 32; ++x) {
+                const GPixel s = *src.bitmap().getAddr(x, y);
+                const uint16_t expected = GPixel_GetA(s) == 0xFF ? pack_565(s) :
+                                          GPixel_GetA(s) == 0 ? bg565 :
+                                          pack_565(blend_srcover(s, expand_565(bg565)));
+                ok &= *(const uint16_t*)dst.getAddr(x, y) == expected;
+            }
+        }
+        stats->expectTrue(ok, names[i]);
+    }
+    delete shader;
+}
+
+// Overlapping coverage on a transparent background; the opaque rect goes through A8's memset
+// path on top of what is already there.
+static void draw_coverage_scene(GCanvas* canvas) {
+    GShader* shader = GShader::LinearGradient({0, 0}, {48, 0}, {0.1f, 1, 0, 0}, {0.9f, 0, 0, 1});
+    GPaint paint(shader);
+    canvas->clear(GColor::MakeARGB(0, 0, 0, 0));
+    canvas->fillRect(GRect::MakeLTRB(4, 4, 40, 24), GColor::MakeARGB(0.5f, 1, 0, 0));
+    canvas->fillRect(GRect::MakeLTRB(10, 8, 30, 36), GColor::MakeARGB(1, 0, 0, 1));
+    canvas->fillRect(GRect::MakeLTRB(20, 2, 46, 30), GColor::MakeARGB(0.3f, 0.2f, 0.8f, 0.1f));
+    canvas->drawRect(GRect::MakeLTRB(0, 26, 48, 40), paint);
+    canvas->fillRect(GRect::MakeLTRB(2, 30, 20, 38), GColor::MakeARGB(1, 0, 1, 0));
+    delete shader;
+}
+
+static void test_a8_canvas(GTestStats* stats) {
+    void (*scenes[])(GCanvas*) = { draw_coverage_scene, draw_mesh_scene };
+
+    for (int i = 0; i < GARRAY_COUNT(scenes); ++i) {
+        GSurface expected(48, 40);
+        scenes[i](expected.canvas());
+
+        std::vector<uint32_t> storage;
+        const FormatBitmap dst = make_format_bitmap(&storage, 48, 40, PixelFormat::kA8);
+        GCanvas* canvas = create_format_canvas(dst);
+        scenes[i](canvas);
+        delete canvas;
+
+        bool ok = true;
+        for (int y = 0; y < 40; ++y) {
+            for (int x = 0; x < 48; ++x) {
+                ok &= *(const uint8_t*)dst.getAddr(x, y) ==
+                      GPixel_GetA(*expected.bitmap().getAddr(x, y));
+            }
+        }
+        stats->expectTrue(ok, "a8_canvas");
+    }
+}
+
+// Writes rows (rowBytes apart) as a PNG in the given libpng format, so the decoder can be fed
+// formats the encoder never produces. palette and trns may be null.
+static bool write_png_fixture(const char path[], int w, int h, int bitDepth, int colorType,
+                              bool interlaced, const uint8_t* rows, size_t rowBytes,
+                              const png_color* palette, int paletteCount,
+                              const uint8_t* trns, int trnsCount) {
+    FILE* file = fopen(path, "wb");
+    if (!file) {
+        return false;
+    }
+    png_structp png = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+    png_infop info = png ? png_create_info_struct(png) : NULL;
+    if (!info || setjmp(png_jmpbuf(png))) {
+        png_destroy_write_struct(&png, &info);
+        fclose(file);
+        return false;
+    }
+    png_init_io(png, file);
+    png_set_IHDR(png, info, w, h, bitDepth, colorType,
+                 interlaced ? PNG_INTERLACE_ADAM7 : PNG_INTERLACE_NONE,
+                 PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
+    if (palette) {
+        png_set_PLTE(png, info, palette, paletteCount);
+    }
+    if (trns) {
+        png_set_tRNS(png, info, trns, trnsCount, NULL);
+    }
+    png_write_info(png, info);
+    std::vector<png_bytep> rowPtrs(h);
+    for (int y = 0; y < h; ++y) {
+        rowPtrs[y] = (png_bytep)(rows + y * rowBytes);
+    }
+    png_write_image(png, rowPtrs.data());
+    png_write_end(png, info);
+    png_destroy_write_struct(&png, &info);
+    fclose(file);
+    return true;
+}
+
+// premultiplied pixel for unpremultiplied 8-bit components
+static GPixel premul_pixel(unsigned a, unsigned r, unsigned g, unsigned b) {
+    return raw_pixel(a, mul_div255(a, r), mul_div255(a, g), mul_div255(a, b));
+}
+
+static bool decodes_to(const char path[], int w, int h, const std::vector<GPixel>& expected) {
+    GBitmap bitmap;
+    if (!bitmap.readFromFile(path)) {
+        return false;
+    }
+    bool ok = bitmap.width() == w && bitmap.height() == h;
+    for (int y = 0; ok && y < h; ++y) {
+        for (int x = 0; x < w; ++x) {
+            ok &= *bitmap.getAddr(x, y) == expected[y * w + x];
+        }
+    }
+    free(bitmap.fPixels);
+    return ok;
+}
+
+static void test_png_decode(GTestStats* stats) {
+    const char* path = "_test_png_decode.png";
+
+    // palette with a tRNS chunk: alpha comes from tRNS and colors are premultiplied
+    const png_color palette[3] = { { 255, 0, 0 }, { 0, 200, 100 }, { 10, 20, 30 } };
+    const uint8_t trns[3] = { 255, 128, 0 };
+    const uint8_t indices[2 * 4] = { 0, 1, 2, 1,
+                                     2, 2, 0, 1 };
+    std::vector<GPixel> expected;
+    for (int i = 0; i < 8; ++i) {
+        const png_color& c = palette[indices[i]];
+        expected.push_back(premul_pixel(trns[indices[i]], c.red, c.green, c.blue));
+    }
+    stats->expectTrue(write_png_fixture(path, 4, 2, 8, PNG_COLOR_TYPE_PALETTE, false, indices, 4,
+                                        palette, 3, trns, 3) &&
+                      decodes_to(path, 4, 2, expected), "png_decode_palette");
+
+    // 16-bit RGBA is scaled, not truncated, to 8 bits: 0x01FF becomes 2, not 1
+    const uint16_t wide[2 * 2 * 4] = {
+        0xFFFF, 0x0000, 0x8080, 0xFFFF,     0x01FF, 0x4040, 0xC0C0, 0xFFFF,
+        0xFFFF, 0xFFFF, 0xFFFF, 0x8080,     0x0000, 0x0000, 0x0000, 0x0000,
+    };
+    uint8_t wide_bytes[sizeof(wide)];
+    for (size_t i = 0; i < GARRAY_COUNT(wide); ++i) {
+        wide_bytes[2 * i] = wide[i] >> 8;       // PNG samples are big endian
+        wide_bytes[2 * i + 1] = wide[i] & 0xFF;
+    }
+    expected = { premul_pixel(0xFF, 0xFF, 0, 0x80), premul_pixel(0xFF, 2, 0x40, 0xC0),
+                 premul_pixel(0x80, 0xFF, 0xFF, 0xFF), 0 };
+    stats->expectTrue(write_png_fixture(path, 2, 2, 16, PNG_COLOR_TYPE_RGBA, false, wide_bytes,
+                                        2 * 8, NULL, 0, NULL, 0) &&
+                      decodes_to(path, 2, 2, expected), "png_decode_16_bit");
+
+    // Adam7 interlaced RGB, odd sized so every pass has partial rows and columns
+    const int W = 13, H = 11;
+    uint8_t rgb[W * H * 3];
+    expected.clear();
+    for (int y = 0; y < H; ++y) {
+        for (int x = 0; x < W; ++x) {
+            uint8_t* p = &rgb[(y * W + x) * 3];
+            p[0] = x * 19;
+            p[1] = y * 23;
+            p[2] = (x * y) & 0xFF;
+            expected.push_back(raw_pixel(0xFF, p[0], p[1], p[2]));
+        }
+    }
+    stats->expectTrue(write_png_fixture(path, W, H, 8, PNG_COLOR_TYPE_RGB, true, rgb, W * 3,
+                                        NULL, 0, NULL, 0) &&
+                      decodes_to(path, W, H, expected), "png_decode_interlaced");
+
+    // the same image decoded into caller owned pixels with a padded row
+    std::vector<GPixel> storage((W + 3) * H);
+    GBitmap into;
+    into.fWidth = W;
+    into.fHeight = H;
+    into.fRowBytes = (W + 3) * sizeof(GPixel);
+    into.fPixels = storage.data();
+    bool same = GDecodePNGInto(path, into);
+    for (int y = 0; same && y < H; ++y) {
+        for (int x = 0; x < W; ++x) {
+            same &= *into.getAddr(x, y) == expected[y * W + x];
+        }
+    }
+    stats->expectTrue(same, "png_decode_into");
+    remove(path);
+}
+
+// Every option combination must decode back to the same premultiplied pixels: unpremultiplying
+// for the PNG and premultiplying again is exact for 8-bit channels.
+static void test_png_encode(GTestStats* stats) {
+    const char* path = "_test_png_encode.png";
+    const int W = 29, H = 37;
+    std::vector<GPixel> pixels(W * H);
+    for (int y = 0; y < H; ++y) {
+        for (int x = 0; x < W; ++x) {
+            const unsigned a = (x * 37 + y * 11) & 0xFF;
+            pixels[y * W + x] = premul_pixel(a, x * 9, y * 7, (x * y * 5) & 0xFF);
+        }
+    }
+    GBitmap src;
+    src.fWidth = W;
+    src.fHeight = H;
+    src.fRowBytes = W * sizeof(GPixel);
+    src.fPixels = pixels.data();
+
+    const GPNGFilter filters[] = {
+        GPNGFilter::kDefault, GPNGFilter::kNone, GPNGFilter::kSub, GPNGFilter::kUp,
+        GPNGFilter::kAverage, GPNGFilter::kPaeth, GPNGFilter::kAdaptive,
+    };
+    const int levels[] = { -1, 0, 1, 9 };
+    const int threads[] = { 1, 2, 3, 8, H + 5 };
+    bool ok = true;
+    for (GPNGFilter filter : filters) {
+        for (int level : levels) {
+            for (int thread_count : threads) {
+                GPNGEncodeOptions options;
+                options.fFilter = filter;
+                options.fZLibLevel = level;
+                options.fThreads = thread_count;
+                ok &= GEncodePNG(src, path, options) && decodes_to(path, W, H, pixels);
+            }
+        }
+    }
+    stats->expectTrue(ok, "png_encode_round_trip");
+
+    // a single row has nothing to split, and writeToFile uses the defaults
+    src.fHeight = 1;
+    GPNGEncodeOptions threaded;
+    threaded.fThreads = 4;
+    const std::vector<GPixel> row(pixels.begin(), pixels.begin() + W);
+    stats->expectTrue(GEncodePNG(src, path, threaded) && decodes_to(path, W, 1, row),
+                      "png_encode_one_row");
+    src.fHeight = H;
+    stats->expectTrue(src.writeToFile(path) && decodes_to(path, W, H, pixels),
+                      "png_encode_default");
+
+    GPNGEncodeOptions bad;
+    bad.fZLibLevel = 10;
+    stats->expectTrue(!GEncodePNG(src, path, bad), "png_encode_bad_level");
+    remove(path);
+}
+
+static void test_raw_bitmap(GTestStats* stats) {
+    const char* path = "_test_raw_bitmap.graw";
+    const int W = 13, H = 7, STRIDE = W + 5;
+
+    // padded rows are written packed and map back with the same pixels
+    std::vector<GPixel> pixels(STRIDE * H, 0xDEADBEEF);
+    GBitmap src;
+    src.fWidth = W;
+    src.fHeight = H;
+    src.fRowBytes = STRIDE * sizeof(GPixel);
+    src.fPixels = pixels.data();
+    for (int y = 0; y < H; ++y) {
+        for (int x = 0; x < W; ++x) {
+            *src.getAddr(x, y) = premul_pixel((x * 40 + y) & 0xFF, x * 19, y * 31, 0x55);
+        }
+    }
+    GMappedBitmap mapped;
+    bool ok = GWriteRawBitmap(src, path) && mapped.map(path);
+    const GBitmap& bm = mapped.bitmap();
+    ok &= bm.width() == W && bm.height() == H && bm.rowBytes() == W * sizeof(GPixel);
+    for (int y = 0; ok && y < H; ++y) {
+        for (int x = 0; x < W; ++x) {
+            ok &= *bm.getAddr(x, y) == *src.getAddr(x, y);
+        }
+    }
+    stats->expectTrue(ok, "raw_bitmap_round_trip");
+
+    mapped.unmap();
+    stats->expectTrue(!mapped.isMapped() && !mapped.bitmap().fPixels, "raw_bitmap_unmap");
+
+    // a file cut short of its last row, or one that is not a raw file, does not map
+    struct stat status;
+    stats->expectTrue(!stat(path, &status) && !truncate(path, status.st_size - 1) &&
+                      !mapped.map(path) && !mapped.isMapped(), "raw_bitmap_truncated");
+    stats->expectTrue(src.writeToFile(path) && !mapped.map(path), "raw_bitmap_not_raw");
+    stats->expectTrue(!mapped.map("_test_raw_bitmap_missing.graw"), "raw_bitmap_missing");
+
+    src.fPixels = NULL;
+    stats->expectTrue(!GWriteRawBitmap(src, path), "raw_bitmap_no_pixels");
+    remove(path);
+}
+
+// A subset shares its parent's pixels: a canvas on the subset writes exactly the parent's
+// pixels inside it, even when a draw overhangs the subset, and writes to the parent show
+// through the subset.
+static void test_subset(GTestStats* stats) {
+    GSurface parent(16, 12);
+    const GBitmap& pbm = parent.bitmap();
+    const GPixel white = raw_pixel(0xFF, 0xFF, 0xFF, 0xFF);
+    const GPixel blue = raw_pixel(0xFF, 0, 0, 0xFF);
+    parent.canvas()->clear(GColor::MakeARGB(1, 1, 1, 1));
+
+    GBitmap view;
+    stats->expectTrue(extract_subset(pbm, GIRect::MakeLTRB(3, 4, 10, 9), &view) &&
+                      view.width() == 7 && view.height() == 5 &&
+                      view.rowBytes() == pbm.rowBytes() && view.pixels() == pbm.getAddr(3, 4),
+                      "subset_view");
+
+    GCanvas* canvas = GCanvas::Create(view);
+    canvas->fillRect(GRect::MakeLTRB(-5, -5, 50, 50), GColor::MakeARGB(1, 0, 0, 1));
+    delete canvas;
+    bool ok = true;
+    for (int y = 0; y < 12; ++y) {
+        for (int x = 0; x < 16; ++x) {
+            const bool inside = x >= 3 && x < 10 && y >= 4 && y < 9;
+            ok &= *pbm.getAddr(x, y) == (inside ? blue : white);
+        }
+    }
+    stats->expectTrue(ok, "subset_draw_aliases_parent");
+
+    *pbm.getAddr(5, 6) = white;
+    stats->expectTrue(*view.getAddr(2, 2) == white, "subset_sees_parent");
+
+    // clipped to the parent; nothing left leaves dst untouched
+    stats->expectTrue(extract_subset(pbm, GIRect::MakeLTRB(-2, -2, 3, 3), &view) &&
+                      view.width() == 3 && view.height() == 3 && view.pixels() == pbm.pixels(),
+                      "subset_clipped");
+    stats->expectTrue(!extract_subset(pbm, GIRect::MakeLTRB(16, 0, 20, 5), &view) &&
+                      view.width() == 3 && view.pixels() == pbm.pixels(), "subset_empty");
+}
+
+// Blending in linear light: 50% white over black is half the light, which encodes to 0xBC rather
+// than the 0x80 an encoded-space blend gives. Checked through blend_color (a solid fill) and
+// blend_row (a shaded fill).
+static void test_srgb_blend(GTestStats* stats) {
+    const GPixel half_white = raw_pixel(0x80, 0x80, 0x80, 0x80);
+    const GPixel expected = raw_pixel(0xFF, 0xBC, 0xBC, 0xBC);
+    GBitmap tex;
+    tex.fWidth = tex.fHeight = 1;
+    tex.fRowBytes = sizeof(GPixel);
+    tex.fPixels = const_cast<GPixel*>(&half_white);
+    GShader* shader = GShader::FromBitmap(tex, GMatrix());
+
+    GPixel pixels[2];
+    const FormatBitmap dst = { 2, 1, sizeof(pixels), pixels, PixelFormat::kSRGB_8888 };
+    GCanvas* canvas = create_format_canvas(dst);
+    canvas->clear(GColor::MakeARGB(1, 0, 0, 0));
+    canvas->fillRect(GRect::MakeLTRB(0, 0, 1, 1), GColor::MakeARGB(0.5f, 1, 1, 1));
+    canvas->drawRect(GRect::MakeLTRB(1, 0, 2, 1), GPaint(shader));
+    delete canvas;
+    delete shader;
+
+    stats->expectTrue(pixels[0] == expected, "srgb_blend_color");
+    stats->expectTrue(pixels[1] == expected, "srgb_blend_row");
+}
+
+// The midpoint of an sRGB gradient is the encoded linear average of its endpoints.
+static void test_srgb_gradient(GTestStats* stats) {
+    const GColor c0 = { 1, 0.2f, 0.9f, 1 }, c1 = { 1, 0.8f, 0.1f, 0 };
+    // pixel 4's center is halfway along the gradient
+    GShader* shader = linear_gradient_srgb({0.5f, 0}, {8.5f, 0}, c0, c1, GShader::TileMode::kClamp);
+    GSurface surface(9, 1);
+    surface.canvas()->drawRect(GRect::MakeWH(9, 1), GPaint(shader));
+    delete shader;
+
+    const GPixel mid = *surface.bitmap().getAddr(4, 0);
+    const float c0s[] = { c0.fR, c0.fG, c0.fB }, c1s[] = { c1.fR, c1.fG, c1.fB };
+    const unsigned actual[] = { GPixel_GetR(mid), GPixel_GetG(mid), GPixel_GetB(mid) };
+    bool ok = GPixel_GetA(mid) == 0xFF;
+    for (int c = 0; c < 3; ++c) {
+        const float average = (srgb_to_linear_exact(c0s[c]) + srgb_to_linear_exact(c1s[c])) / 2;
+        ok &= actual[c] == linear_to_srgb_byte(srgb_tables(), average);
+    }
+    stats->expectTrue(ok, "srgb_gradient_mid");
+}
+
+static void test_srgb_row_paths(GTestStats* stats) {
+    GRandom rand;
+    std::vector<GPixel> src(4096), dst(4096);
+    for (size_t i = 0; i < src.size(); ++i) {
+        const unsigned a = rand.nextU() & 0xFF, d = rand.nextU() & 0xFF;
+        src[i] = premul_pixel(a, rand.nextU() & 0xFF, rand.nextU() & 0xFF, rand.nextU() & 0xFF);
+        dst[i] = premul_pixel(d, rand.nextU() & 0xFF, rand.nextU() & 0xFF, rand.nextU() & 0xFF);
+    }
+    std::vector<GPixel> scalar = dst;
+    blend_srgb_row(srgb_tables(), dst.data(), src.data(), (int)src.size());
+    blend_srgb_row_scalar(srgb_tables(), scalar.data(), src.data(), (int)src.size());
+    stats->expectTrue(dst == scalar, "srgb_row_paths");
+}
+
+static bool irect_eq(const GIRect& a, const GIRect& b) {
+    return a.left() == b.left() && a.top() == b.top() && a.right() == b.right() &&
+           a.bottom() == b.bottom();
+}
+
+// No two rects of the region touch, and every pixel of covered is inside one of them.
+static bool dirty_region_ok(const DirtyRegion& region, const std::vector<bool>& covered, int w) {
+    const std::vector<GIRect>& rects = region.rects();
+    if (rects.size() > DIRTY_MAX_RECTS) {
+        return false;
+    }
+    for (size_t i = 0; i < rects.size(); ++i) {
+        for (size_t j = i + 1; j < rects.size(); ++j) {
+            const GIRect& a = rects[i];
+            const GIRect& b = rects[j];
+            if (a.left() <= b.right() && b.left() <= a.right() &&
+                a.top() <= b.bottom() && b.top() <= a.bottom()) {
+                return false;
+            }
+        }
+    }
+    for (size_t p = 0; p < covered.size(); ++p) {
+        const int x = p % w, y = p / w;
+        bool inside = !covered[p];
+        for (const GIRect& r : rects) {
+            inside |= x >= r.left() && x < r.right() && y >= r.top() && y < r.bottom();
+        }
+        if (!inside) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void test_dirty_region(GTestStats* stats) {
+    DirtyRegion region;
+    region.add(GIRect::MakeLTRB(0, 0, 10, 10));
+    region.add(GIRect::MakeLTRB(10, 4, 20, 6));     // shares an edge
+    stats->expectTrue(region.rects().size() == 1 &&
+                      irect_eq(region.rects()[0], GIRect::MakeLTRB(0, 0, 20, 10)), "dirty_merge");
+
+    // spans growing one rect until it reaches another merge the two
+    region.clear();
+    region.add(GIRect::MakeLTRB(0, 0, 10, 10));
+    region.add_span(30, 0, 10);
+    region.add_span(20, 1, 12);
+    region.add_span(10, 2, 12);
+    stats->expectTrue(region.rects().size() == 1 &&
+                      irect_eq(region.rects()[0], GIRect::MakeLTRB(0, 0, 40, 10)), "dirty_span_merge");
+
+    // one rect too many: the two closest ones merge
+    region.clear();
+    for (int i = 0; i < DIRTY_MAX_RECTS; ++i) {
+        region.add(GIRect::MakeLTRB(i * 10, 0, i * 10 + 2, 2));
+    }
+    const int last = (DIRTY_MAX_RECTS - 1) * 10;
+    region.add(GIRect::MakeLTRB(last + 5, 0, last + 7, 2));
+    bool merged = false;
+    for (const GIRect& r : region.rects()) {
+        merged |= irect_eq(r, GIRect::MakeLTRB(last, 0, last + 7, 2));
+    }
+    stats->expectTrue(region.rects().size() == DIRTY_MAX_RECTS && merged, "dirty_cap");
+
+    // random rects and spans never leave out a pixel
+    const int w = 96, h = 64;
+    GRandom rand;
+    bool ok = true;
+    for (int round = 0; round < 50; ++round) {
+        region.clear();
+        std::vector<bool> covered(w * h);
+        for (int k = 0; k < 40; ++k) {
+            const int x = rand.nextU() % (w - 8), y = rand.nextU() % (h - 8);
+            const int cw = 1 + rand.nextU() % 8, ch = 1 + rand.nextU() % 8;
+            for (int row = y; row < y + ch; ++row) {
+                if (k & 1) {
+                    region.add_span(x, row, cw);
+                }
+                for (int col = x; col < x + cw; ++col) {
+                    covered[row * w + col] = true;
+                }
+            }
+            if (!(k & 1)) {
+                region.add(GIRect::MakeLTRB(x, y, x + cw, y + ch));
+            }
+        }
+        ok &= dirty_region_ok(region, covered, w);
+    }
+    stats->expectTrue(ok, "dirty_superset");
+
+    // a tracking canvas reports spans moved by its offset
+    std::vector<GPixel> storage;
+    const GBitmap bitmap = make_ramp_bitmap(&storage, 16, 16);
+    region.clear();
+    GCanvas* canvas = create_tracking_canvas(bitmap, &region, 5, 7);
+    canvas->fillRect(GRect::MakeLTRB(2, 3, 6, 8), GColor::MakeARGB(1, 0, 0, 1));
+    delete canvas;
+    stats->expectTrue(region.rects().size() == 1 &&
+                      irect_eq(region.rects()[0], GIRect::MakeLTRB(7, 10, 11, 15)), "dirty_offset");
+}
+
+static bool is_aligned(const GBitmap& bitmap) {
+    return (uintptr_t)bitmap.pixels() % PIXEL_ALIGN == 0 && bitmap.rowBytes() % PIXEL_ALIGN == 0 &&
+           bitmap.rowBytes() >= bitmap.width() * sizeof(GPixel);
+}
+
+static void test_owned_bitmap(GTestStats* stats) {
+    PixelPool pool;
+    PixelPool* pools[] = { nullptr, &pool };
+    bool aligned = true;
+    for (PixelPool* p : pools) {
+        for (int w : { 1, 3, 17, 33, 101 }) {
+            OwnedBitmap owned(w, 5, p);
+            aligned &= is_aligned(owned.bitmap()) &&
+                       is_filled_with(owned.bitmap(), GPixel_PackARGB(0, 0, 0, 0));
+        }
+    }
+    stats->expectTrue(aligned, "owned_bitmap_aligned");
+
+    // decoded bitmaps get the same rows
+    {
+        OwnedBitmap owned(17, 3);
+        GBitmap decoded;
+        aligned = owned.bitmap().writeToFile("_test_owned_bitmap.png") &&
+                  decoded.readFromFile("_test_owned_bitmap.png") && is_aligned(decoded);
+        free(decoded.fPixels);
+        stats->expectTrue(aligned, "owned_bitmap_decoded_aligned");
+    }
+
+    // 17 x 9 and 17 x 12 pad to 32 pixel rows, both in the 512 pixel class
+    GPixel* recycled;
+    {
+        OwnedBitmap owned(17, 9, &pool);
+        recycled = owned.bitmap().pixels();
+        GCanvas* canvas = GCanvas::Create(owned.bitmap());
+        canvas->clear(GColor::MakeARGB(1, 1, 1, 1));
+        delete canvas;
+    }
+    {
+        OwnedBitmap owned(17, 12, &pool);
+        stats->expectTrue(owned.bitmap().pixels() == recycled, "pixel_pool_reuse");
+        stats->expectTrue(is_filled_with(owned.bitmap(), GPixel_PackARGB(0, 0, 0, 0)),
+                          "pixel_pool_zeroed");
+    }
+
+    // one buffer more than the pool keeps goes back to the heap
+    OwnedBitmap* owned[PIXEL_POOL_KEEP + 1];
+    for (OwnedBitmap*& o : owned) {
+        o = new OwnedBitmap(17, 9, &pool);
+    }
+    for (OwnedBitmap* o : owned) {
+        delete o;
+    }
+    stats->expectTrue(pool.kept(32 * 9) == PIXEL_POOL_KEEP, "pixel_pool_keep");
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
 const GTestRec gTestRecs[] = {
     { test_bad_input,   "bad_input"     },
 
@@ -396,9 +2014,42 @@ const GTestRec gTestRecs[] = {
 
     { test_bad_input_poly, "poly_bad_input" },
     { test_offscreen_poly, "poly_offscreen" },
+    { test_edge_poly, "poly_edge" },
+    { test_clipped_edges, "clipped_edges" },
+    { test_gradient_clamp, "gradient_clamp" },
 
     { test_matrix,  "matrix" },
 
+    { test_div255,  "div255" },
+
+    { test_path_quad, "path_quad" },
+    { test_path_cubic, "path_cubic" },
+    { test_path_contains, "path_contains" },
+    { test_quad_patch, "quad_patch" },
+    { test_geometry_cache, "geometry_cache" },
+    { test_mask_cache, "mask_cache" },
+    { test_atlas, "atlas" },
+    { test_nine_patch, "nine_patch" },
+    { test_save_layer, "save_layer" },
+    { test_deferred, "deferred" },
+    { test_float_canvas, "float_canvas" },
+    { test_f16_round_trip, "f16_round_trip" },
+    { test_bgra_canvas, "bgra_canvas" },
+    { test_565_canvas, "565_canvas" },
+    { test_a8_canvas, "a8_canvas" },
+    { test_srgb_blend, "srgb_blend" },
+    { test_srgb_gradient, "srgb_gradient" },
+    { test_srgb_row_paths, "srgb_row_paths" },
+    { test_dirty_region, "dirty_region" },
+    { test_owned_bitmap, "owned_bitmap" },
+
+    { test_png_decode, "png_decode" },
+    { test_png_encode, "png_encode" },
+    { test_raw_bitmap, "raw_bitmap" },
+    { test_subset, "subset" },
+    { test_fill_rules, "fill_rules" },
+    { test_rects_match_poly, "rects_match_poly" },
+
     { NULL, NULL },
 };
 
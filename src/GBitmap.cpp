@@ -3,7 +3,19 @@
  */
 
 #include "GBitmap.h"
+#include "GPNGCodec.h"
+#include "../Owned_Bitmap.h"
+#include "../Pixel_Math.h"
 #include <png.h>
+#include <zlib.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <thread>
+#include <vector>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 class GAutoFClose {
 public:
@@ -14,52 +26,49 @@ private:
     FILE* fFP;
 };
 
-class GAutoFree {
-public:
-    GAutoFree(void* ptr) : fPtr(ptr) {}
-    ~GAutoFree() { ::free(fPtr); }
-
-    void* get() const { return fPtr; }
-
-    void* detach() {
-        void* ptr = fPtr;
-        fPtr = NULL;
-        return ptr;
-    }
-
-private:
-    void* fPtr;
-};
+// [a][c] -> c unpremultiplied by a, rounded and clamped
+static const uint8_t* unpremul_table() {
+    static uint8_t* table = [] {
+        uint8_t* t = (uint8_t*)malloc(256 * 256);
+        for (int a = 0; a < 256; a++) {
+            for (int c = 0; c < 256; c++) {
+                int v = (0 == a || 255 == a) ? c : (c * 255 + a/2) / a;
+                t[(a << 8) | c] = v > 255 ? 255 : v;
+            }
+        }
+        return t;
+    }();
+    return table;
+}
 
 static void convertToPNG(const GPixel src[], int width, char dst[]) {
+    // PNG requires unpremultiplied, but GPixel is premultiplied
+    const uint8_t* table = unpremul_table();
     for (int i = 0; i < width; i++) {
         GPixel c = *src++;
         int a = GPixel_GetA(c);
-        int r = GPixel_GetR(c);
-        int g = GPixel_GetG(c);
-        int b = GPixel_GetB(c);
-        
-        // PNG requires unpremultiplied, but GPixel is premultiplied
-        if (0 != a && 255 != a) {
-            r = (r * 255 + a/2) / a;
-            g = (g * 255 + a/2) / a;
-            b = (b * 255 + a/2) / a;
-        }
-        *dst++ = r;
-        *dst++ = g;
-        *dst++ = b;
+        const uint8_t* row = table + (a << 8);
+        *dst++ = row[GPixel_GetR(c)];
+        *dst++ = row[GPixel_GetG(c)];
+        *dst++ = row[GPixel_GetB(c)];
         *dst++ = a;
     }
 }
 
-bool GBitmap::writeToFile(const char path[]) const {
-    FILE* f = ::fopen(path, "wb");
-    if (!f) {
-        return false;
+static int png_filter_flags(GPNGFilter filter) {
+    switch (filter) {
+        case GPNGFilter::kNone:     return PNG_FILTER_NONE;
+        case GPNGFilter::kSub:      return PNG_FILTER_SUB;
+        case GPNGFilter::kUp:       return PNG_FILTER_UP;
+        case GPNGFilter::kAverage:  return PNG_FILTER_AVG;
+        case GPNGFilter::kPaeth:    return PNG_FILTER_PAETH;
+        case GPNGFilter::kAdaptive: return PNG_ALL_FILTERS;
+        case GPNGFilter::kDefault:  break;
     }
+    return 0;
+}
 
-    GAutoFClose afc(f);
-
+static bool write_png_serial(const GBitmap& src, FILE* f, const GPNGEncodeOptions& options) {
     png_structp png_ptr = png_create_write_struct(PNG_LIBPNG_VER_STRING,
                                                   NULL, NULL, NULL);
     if (!png_ptr) {
@@ -71,42 +80,296 @@ bool GBitmap::writeToFile(const char path[]) const {
         png_destroy_write_struct(&png_ptr,  NULL);
         return false;
     }
-    
+
+    char* volatile scanline = NULL;
     if (setjmp(png_jmpbuf(png_ptr))) {
+        free(scanline);
         png_destroy_write_struct(&png_ptr, &info_ptr);
         return false;
     }
 
     png_init_io(png_ptr, f);
-    
-    if (setjmp(png_jmpbuf(png_ptr))) {
-        return false;
+    if (options.fZLibLevel >= 0) {
+        png_set_compression_level(png_ptr, options.fZLibLevel);
+    }
+    if (GPNGFilter::kDefault != options.fFilter) {
+        png_set_filter(png_ptr, PNG_FILTER_TYPE_BASE, png_filter_flags(options.fFilter));
     }
     
     const int bitDepth = 8;
-    png_set_IHDR(png_ptr, info_ptr, fWidth, fHeight, bitDepth,
+    png_set_IHDR(png_ptr, info_ptr, src.fWidth, src.fHeight, bitDepth,
                  PNG_COLOR_TYPE_RGB_ALPHA, PNG_INTERLACE_NONE,
                  PNG_COMPRESSION_TYPE_BASE, PNG_FILTER_TYPE_BASE);
     png_write_info(png_ptr, info_ptr);
 
-    char* scanline = (char*)malloc(fWidth * sizeof(GPixel));
-    GAutoFree gaf(scanline);
+    scanline = (char*)malloc(src.fWidth * sizeof(GPixel));
 
-    const GPixel* srcRow = fPixels;
-    for (int y = 0; y < fHeight; y++) {
-        convertToPNG(srcRow, fWidth, scanline);
+    const GPixel* srcRow = src.fPixels;
+    for (int y = 0; y < src.fHeight; y++) {
+        convertToPNG(srcRow, src.fWidth, scanline);
         png_bytep row_ptr = (png_bytep)scanline;
         png_write_rows(png_ptr, &row_ptr, 1);
-        srcRow = (const GPixel*)((const char*)srcRow + fRowBytes);
+        srcRow = (const GPixel*)((const char*)srcRow + src.fRowBytes);
     }
 
     png_write_end(png_ptr, NULL);
     png_destroy_write_struct(&png_ptr, &info_ptr);
+    free(scanline);
     return true;
 }
 
+///////////////////////////////////////////////////////////////////////////////
+// Parallel encode: each band of rows is filtered and deflated on its own thread into a
+// raw deflate stream that ends on a byte boundary (Z_SYNC_FLUSH), so the bands can be
+// written back to back as the IDAT data of one zlib stream. Only the last band finishes
+// the stream, and the per band adler32s are combined for the zlib trailer. The bands run
+// on std::thread, so programs linking this file need -pthread.
+
+static inline int paeth_predict(int a, int b, int c) {
+    int p = a + b - c;
+    int pa = abs(p - a);
+    int pb = abs(p - b);
+    int pc = abs(p - c);
+    if (pa <= pb && pa <= pc) {
+        return a;
+    }
+    return pb <= pc ? b : c;
+}
+
+// writes the filter type and count filtered bytes of cur to dst, prev is the row above
+static void filter_row(int type, const uint8_t cur[], const uint8_t prev[], int count, uint8_t dst[]) {
+    const int bpp = sizeof(GPixel);
+    *dst++ = type;
+    for (int i = 0; i < count; i++) {
+        int a = i >= bpp ? cur[i - bpp] : 0;
+        int b = prev[i];
+        int c = i >= bpp ? prev[i - bpp] : 0;
+        int pred = 0;
+        switch (type) {
+            case PNG_FILTER_VALUE_SUB:   pred = a; break;
+            case PNG_FILTER_VALUE_UP:    pred = b; break;
+            case PNG_FILTER_VALUE_AVG:   pred = (a + b) >> 1; break;
+            case PNG_FILTER_VALUE_PAETH: pred = paeth_predict(a, b, c); break;
+        }
+        dst[i] = cur[i] - pred;
+    }
+}
+
+static unsigned filter_cost(const uint8_t filtered[], int count) {
+    unsigned sum = 0;
+    for (int i = 0; i < count; i++) {
+        sum += abs((int8_t)filtered[i]);
+    }
+    return sum;
+}
+
+static int filter_value(GPNGFilter filter) {
+    switch (filter) {
+        case GPNGFilter::kNone:     return PNG_FILTER_VALUE_NONE;
+        case GPNGFilter::kSub:      return PNG_FILTER_VALUE_SUB;
+        case GPNGFilter::kUp:       return PNG_FILTER_VALUE_UP;
+        case GPNGFilter::kAverage:  return PNG_FILTER_VALUE_AVG;
+        case GPNGFilter::kPaeth:    return PNG_FILTER_VALUE_PAETH;
+        case GPNGFilter::kDefault:
+        case GPNGFilter::kAdaptive: break;
+    }
+    return -1;
+}
+
+struct PNGBand {
+    int                  fTop, fBottom;
+    std::vector<uint8_t> fData;     // raw deflate output
+    uLong                fAdler;
+    uLong                fLength;   // uncompressed bytes
+    bool                 fOK;
+};
+
+// Deflates all of zs's input into out, growing out when it fills. A flush is only complete
+// once deflate returns with output space to spare, and Z_FINISH only once the stream ends,
+// so both are repeated until then; anything else is an error.
+static bool deflate_into(z_stream* zs, std::vector<uint8_t>* out, int flush) {
+    for (;;) {
+        if (0 == zs->avail_out) {
+            const size_t used = out->size();
+            out->resize(used * 2 + 64);
+            zs->next_out = &(*out)[used];
+            zs->avail_out = out->size() - used;
+        }
+        int err = deflate(zs, flush);
+        if (Z_FINISH == flush) {
+            if (Z_STREAM_END == err) {
+                return true;
+            }
+        } else if (0 == zs->avail_in && zs->avail_out) {
+            return Z_OK == err;
+        }
+        // Z_BUF_ERROR with room left means deflate cannot make progress
+        if ((Z_OK != err && Z_BUF_ERROR != err) || (Z_BUF_ERROR == err && zs->avail_out)) {
+            return false;
+        }
+    }
+}
+
+static void encode_band(const GBitmap& src, const GPNGEncodeOptions& options, bool last, PNGBand* band) {
+    const int rowBytes = src.fWidth * sizeof(GPixel);
+    std::vector<uint8_t> prev(rowBytes, 0), cur(rowBytes);
+    std::vector<uint8_t> filtered(1 + rowBytes), best(1 + rowBytes);
+    if (band->fTop > 0) {
+        convertToPNG(src.getAddr(0, band->fTop - 1), src.fWidth, (char*)&prev[0]);
+    }
+    const int fixed = filter_value(options.fFilter);
+
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    band->fOK = false;
+    band->fAdler = adler32(0, NULL, 0);
+    band->fLength = 0;
+    if (Z_OK != deflateInit2(&zs, options.fZLibLevel, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY)) {
+        return;
+    }
+    band->fData.resize(deflateBound(&zs, (uLong)(band->fBottom - band->fTop) * (1 + rowBytes)) + 16);
+    zs.next_out = &band->fData[0];
+    zs.avail_out = band->fData.size();
+
+    for (int y = band->fTop; y < band->fBottom; y++) {
+        convertToPNG(src.getAddr(0, y), src.fWidth, (char*)&cur[0]);
+        if (fixed >= 0) {
+            filter_row(fixed, &cur[0], &prev[0], rowBytes, &best[0]);
+        } else {
+            unsigned bestCost = ~0u;
+            for (int type = PNG_FILTER_VALUE_NONE; type <= PNG_FILTER_VALUE_PAETH; type++) {
+                filter_row(type, &cur[0], &prev[0], rowBytes, &filtered[0]);
+                unsigned cost = filter_cost(&filtered[1], rowBytes);
+                if (cost < bestCost) {
+                    bestCost = cost;
+                    best.swap(filtered);
+                }
+            }
+        }
+        band->fAdler = adler32(band->fAdler, &best[0], best.size());
+        band->fLength += best.size();
+
+        zs.next_in = &best[0];
+        zs.avail_in = best.size();
+        int flush = y + 1 < band->fBottom ? Z_NO_FLUSH : (last ? Z_FINISH : Z_SYNC_FLUSH);
+        if (!deflate_into(&zs, &band->fData, flush)) {
+            deflateEnd(&zs);
+            return;
+        }
+        prev.swap(cur);
+    }
+    band->fData.resize(band->fData.size() - zs.avail_out);
+    deflateEnd(&zs);
+    band->fOK = true;
+}
+
+static void put_be32(uint8_t dst[], uint32_t v) {
+    dst[0] = v >> 24;
+    dst[1] = v >> 16;
+    dst[2] = v >> 8;
+    dst[3] = v;
+}
+
+static bool write_chunk(FILE* f, const char type[4], const uint8_t data[], uint32_t length,
+                        const uint8_t prefix[] = NULL, uint32_t prefixLength = 0) {
+    uint8_t header[8];
+    put_be32(header, length + prefixLength);
+    memcpy(header + 4, type, 4);
+    uLong crc = crc32(crc32(0, NULL, 0), header + 4, 4);
+    if (prefixLength) {
+        crc = crc32(crc, prefix, prefixLength);
+    }
+    if (length) {
+        crc = crc32(crc, data, length);
+    }
+    uint8_t trailer[4];
+    put_be32(trailer, crc);
+    return 8 == fwrite(header, 1, 8, f) &&
+           prefixLength == fwrite(prefix, 1, prefixLength, f) &&
+           length == fwrite(data, 1, length, f) &&
+           4 == fwrite(trailer, 1, 4, f);
+}
+
+static bool write_png_parallel(const GBitmap& src, FILE* f, const GPNGEncodeOptions& options) {
+    const int bandCount = std::min(options.fThreads, src.fHeight);
+    std::vector<PNGBand> bands(bandCount);
+    for (int i = 0; i < bandCount; i++) {
+        bands[i].fTop = (int)((int64_t)src.fHeight * i / bandCount);
+        bands[i].fBottom = (int)((int64_t)src.fHeight * (i + 1) / bandCount);
+    }
+
+    std::vector<std::thread> threads;
+    for (int i = 1; i < bandCount; i++) {
+        threads.push_back(std::thread(encode_band, std::cref(src), std::cref(options),
+                                      i == bandCount - 1, &bands[i]));
+    }
+    encode_band(src, options, 1 == bandCount, &bands[0]);
+    for (size_t i = 0; i < threads.size(); i++) {
+        threads[i].join();
+    }
+
+    uLong adler = adler32(0, NULL, 0);
+    for (int i = 0; i < bandCount; i++) {
+        if (!bands[i].fOK) {
+            return false;
+        }
+        adler = adler32_combine(adler, bands[i].fAdler, bands[i].fLength);
+    }
+
+    static const uint8_t signature[8] = { 137, 'P', 'N', 'G', '\r', '\n', 26, '\n' };
+    uint8_t ihdr[13];
+    put_be32(ihdr, src.fWidth);
+    put_be32(ihdr + 4, src.fHeight);
+    ihdr[8] = 8;
+    ihdr[9] = PNG_COLOR_TYPE_RGB_ALPHA;
+    ihdr[10] = PNG_COMPRESSION_TYPE_BASE;
+    ihdr[11] = PNG_FILTER_TYPE_BASE;
+    ihdr[12] = PNG_INTERLACE_NONE;
+    if (8 != fwrite(signature, 1, 8, f) || !write_chunk(f, "IHDR", ihdr, 13)) {
+        return false;
+    }
+
+    // the zlib header leads the first IDAT, its adler32 trailer gets one of its own
+    const int level = options.fZLibLevel < 0 ? 6 : options.fZLibLevel;
+    const int flevel = level < 2 ? 0 : (level < 6 ? 1 : (6 == level ? 2 : 3));
+    uint8_t zheader[2] = { 0x78, (uint8_t)(flevel << 6) };
+    zheader[1] += 31 - (zheader[0] * 256 + zheader[1]) % 31;
+    for (int i = 0; i < bandCount; i++) {
+        const std::vector<uint8_t>& data = bands[i].fData;
+        if (!write_chunk(f, "IDAT", data.empty() ? NULL : &data[0], data.size(),
+                         0 == i ? zheader : NULL, 0 == i ? 2 : 0)) {
+            return false;
+        }
+    }
+    uint8_t ztrailer[4];
+    put_be32(ztrailer, adler);
+    return write_chunk(f, "IDAT", ztrailer, 4) && write_chunk(f, "IEND", NULL, 0);
+}
+
+bool GEncodePNG(const GBitmap& src, const char path[], const GPNGEncodeOptions& options) {
+    if (src.fWidth <= 0 || src.fHeight <= 0 || options.fZLibLevel > 9) {
+        return false;
+    }
+    FILE* f = ::fopen(path, "wb");
+    if (!f) {
+        return false;
+    }
+
+    GAutoFClose afc(f);
+
+    if (options.fThreads > 1 && src.fHeight > 1) {
+        return write_png_parallel(src, f, options);
+    }
+    return write_png_serial(src, f, options);
+}
+
+bool GBitmap::writeToFile(const char path[]) const {
+    return GEncodePNG(*this, path, GPNGEncodeOptions());
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 
+// Destroys the read struct, however decoding ends.
 class GAutoPNGReader {
 public:
     GAutoPNGReader(png_structp png, png_infop info) {
@@ -115,7 +378,7 @@ public:
     }
     
     ~GAutoPNGReader() {
-        png_read_end(fPng, fInfo);
+        png_destroy_read_struct(&fPng, &fInfo, NULL);
     }
 
 private:
@@ -123,25 +386,56 @@ private:
     png_infop   fInfo;
 };
 
-static void swizzle_rgb_row(GPixel dst[], const uint8_t src[], int count) {
-    for (int i = 0; i < count; ++i) {
-        dst[i] = GPixel_PackARGB(0xFF, src[0], src[1], src[2]);
-        src += 3;
+// The swizzlers turn libpng's RGBA bytes into premultiplied GPixels. They may run in
+// place, dst and src pointing at the same row.
+
+static void swizzle_rgbx_row(GPixel dst[], const uint8_t src[], int count) {
+    int i = 0;
+#if defined(__SSE2__) && GPIXEL_SHIFT_A == 24 && GPIXEL_SHIFT_R == 16 && GPIXEL_SHIFT_G == 8 && GPIXEL_SHIFT_B == 0
+    const __m128i ga = _mm_set1_epi32(0xFF00FF00);
+    const __m128i lo = _mm_set1_epi32(0xFF);
+    const __m128i opaque = _mm_set1_epi32(0xFF000000);
+    for (; i + 4 <= count; i += 4) {
+        __m128i px = _mm_loadu_si128((const __m128i*)(src + 4*i));
+        __m128i rb = _mm_or_si128(_mm_and_si128(_mm_srli_epi32(px, 16), lo),
+                                  _mm_slli_epi32(_mm_and_si128(px, lo), 16));
+        px = _mm_or_si128(_mm_or_si128(_mm_and_si128(px, ga), rb), opaque);
+        _mm_storeu_si128((__m128i*)(dst + i), px);
+    }
+#endif
+    for (; i < count; ++i) {
+        dst[i] = GPixel_PackARGB(0xFF, src[4*i + 0], src[4*i + 1], src[4*i + 2]);
     }
-}
-
-static int alpha_mul(unsigned a, unsigned c) {
-    return (a * c + 127) / 255;
 }
 
 static void swizzle_rgba_row(GPixel dst[], const uint8_t src[], int count) {
-    for (int i = 0; i < count; ++i) {
-        unsigned a = src[3];
-        dst[i] = GPixel_PackARGB(a,
-                                 alpha_mul(a, src[0]),
-                                 alpha_mul(a, src[1]),
-                                 alpha_mul(a, src[2]));
-        src += 4;
+    int i = 0;
+#if defined(__SSE2__) && GPIXEL_SHIFT_A == 24 && GPIXEL_SHIFT_R == 16 && GPIXEL_SHIFT_G == 8 && GPIXEL_SHIFT_B == 0
+    const __m128i zero = _mm_setzero_si128();
+    // multiply colors by a and alpha by 255, which the rounding divide turns back into a
+    const __m128i color_mask = _mm_set_epi16(0, -1, -1, -1, 0, -1, -1, -1);
+    const __m128i alpha_255 = _mm_set_epi16(255, 0, 0, 0, 255, 0, 0, 0);
+    for (; i + 4 <= count; i += 4) {
+        __m128i px = _mm_loadu_si128((const __m128i*)(src + 4*i));
+        __m128i half[2] = { _mm_unpacklo_epi8(px, zero), _mm_unpackhi_epi8(px, zero) };
+        for (int h = 0; h < 2; ++h) {
+            // r g b a -> b g r a, the byte order of a GPixel in memory
+            __m128i c = _mm_shufflehi_epi16(_mm_shufflelo_epi16(half[h], _MM_SHUFFLE(3, 0, 1, 2)),
+                                            _MM_SHUFFLE(3, 0, 1, 2));
+            __m128i a = _mm_shufflehi_epi16(_mm_shufflelo_epi16(half[h], _MM_SHUFFLE(3, 3, 3, 3)),
+                                            _MM_SHUFFLE(3, 3, 3, 3));
+            __m128i x = _mm_mullo_epi16(c, _mm_or_si128(_mm_and_si128(a, color_mask), alpha_255));
+            half[h] = div255_epu16(x);
+        }
+        _mm_storeu_si128((__m128i*)(dst + i), _mm_packus_epi16(half[0], half[1]));
+    }
+#endif
+    for (; i < count; ++i) {
+        unsigned r = src[4*i + 0];
+        unsigned g = src[4*i + 1];
+        unsigned b = src[4*i + 2];
+        unsigned a = src[4*i + 3];
+        dst[i] = GPixel_PackARGB(a, div255(a * r), div255(a * g), div255(a * b));
     }
 }
 
@@ -154,9 +448,12 @@ static bool always_false() {
     return false;
 }
 
-bool GBitmap::readFromFile(const char path[]) {
-    this->reset();
-
+// Decodes the PNG at path into bitmap. With allocate the pixels come from alloc_aligned_pixels,
+// rows padded like an OwnedBitmap's but still released with free(), and bitmap is set to the
+// image; otherwise bitmap's pixels are written and must match the image's size.
+// Every color type and bit depth is expanded by libpng to 8-bit RGBA, which has the size
+// of a GPixel, so rows decode in place and are swizzled where they land.
+static bool decode_png(const char path[], GBitmap* bitmap, bool allocate, int* size_w, int* size_h) {
     FILE* file = fopen(path, "rb");
     if (NULL == file) {
         return always_false();
@@ -184,8 +481,11 @@ bool GBitmap::readFromFile(const char path[]) {
     }
     
     GAutoPNGReader reader(png_ptr, info_ptr);
-    
+
+    // owned until the decode succeeds, freed if libpng bails out
+    GPixel* volatile storage = NULL;
     if (setjmp(png_jmpbuf(png_ptr))) {
+        free(storage);
         return always_false();
     }
     
@@ -197,51 +497,92 @@ bool GBitmap::readFromFile(const char path[]) {
     int bitDepth, colorType;
     png_get_IHDR(png_ptr, info_ptr, &width, &height, &bitDepth, &colorType,
                  NULL, NULL, NULL);
+    if (size_w) {
+        *size_w = width;
+        *size_h = height;
+        return true;
+    }
 
-    if (8 != bitDepth) {
-        return always_false();   // TODO: handle other formats
+    bool hasAlpha = (colorType & PNG_COLOR_MASK_ALPHA) != 0;
+    if (PNG_COLOR_TYPE_PALETTE == colorType) {
+        png_set_palette_to_rgb(png_ptr);
     }
-    if (png_set_interlace_handling(png_ptr) > 1) {
-        return always_false();   // TODO: support interleave
+    if (PNG_COLOR_TYPE_GRAY == colorType && bitDepth < 8) {
+        png_set_expand_gray_1_2_4_to_8(png_ptr);
     }
-
-    swizzle_row_proc row_proc = NULL;
-    switch (colorType) {
-        case PNG_COLOR_TYPE_RGB:
-            row_proc = swizzle_rgb_row;
-            break;
-        case PNG_COLOR_TYPE_RGB_ALPHA:
-            row_proc = swizzle_rgba_row;
-            break;
-        default:
-            return always_false();
+    if (png_get_valid(png_ptr, info_ptr, PNG_INFO_tRNS)) {
+        png_set_tRNS_to_alpha(png_ptr);
+        hasAlpha = true;
     }
-
+    if (16 == bitDepth) {
+        png_set_scale_16(png_ptr);
+    }
+    if (!(colorType & PNG_COLOR_MASK_COLOR)) {
+        png_set_gray_to_rgb(png_ptr);
+    }
+    if (!hasAlpha) {
+        png_set_filler(png_ptr, 0xFF, PNG_FILLER_AFTER);
+    }
+    const int passes = png_set_interlace_handling(png_ptr);
     png_read_update_info(png_ptr, info_ptr);
 
-    GAutoFree rowStorage(malloc(png_get_rowbytes(png_ptr, info_ptr)));
-    png_bytep srcRow = (png_bytep)rowStorage.get();
-    if (!srcRow) {
+    if (png_get_rowbytes(png_ptr, info_ptr) != width * sizeof(GPixel)) {
         return always_false();
     }
+    swizzle_row_proc row_proc = hasAlpha ? swizzle_rgba_row : swizzle_rgbx_row;
 
-    GAutoFree pixelStorage(malloc(height * width * 4));
-    GPixel* dstRow = (GPixel*)pixelStorage.get();
-    if (NULL == dstRow) {
-        return always_false();
+    GBitmap dst;
+    if (allocate) {
+        const size_t rowBytes = OwnedBitmap::aligned_row_bytes(width);
+        storage = alloc_aligned_pixels(rowBytes / sizeof(GPixel) * height);
+        if (NULL == storage) {
+            return always_false();
+        }
+        dst.fWidth = width;
+        dst.fHeight = height;
+        dst.fRowBytes = rowBytes;
+        dst.fPixels = storage;
+    } else {
+        dst = *bitmap;
+        if (dst.width() != (int)width || dst.height() != (int)height || !dst.fPixels ||
+            dst.rowBytes() < width * sizeof(GPixel)) {
+            return always_false();
+        }
     }
 
-    for (int y = 0; y < height; y++) {
-        uint8_t* tmp = srcRow;
-        png_read_rows(png_ptr, &tmp, NULL, 1);
-        row_proc(dstRow, srcRow, width);
-        dstRow += width;
+    // later interlace passes fill in earlier rows, so those are swizzled once all are in
+    for (int pass = 0; pass < passes; ++pass) {
+        for (int y = 0; y < (int)height; y++) {
+            png_bytep row = (png_bytep)dst.getAddr(0, y);
+            png_read_row(png_ptr, row, NULL);
+            if (1 == passes) {
+                row_proc((GPixel*)row, row, width);
+            }
+        }
+    }
+    if (passes > 1) {
+        for (int y = 0; y < (int)height; y++) {
+            row_proc(dst.getAddr(0, y), (const uint8_t*)dst.getAddr(0, y), width);
+        }
     }
+    png_read_end(png_ptr, NULL);
 
-    fWidth = width;
-    fHeight = height;
-    fRowBytes = width * 4;
-    fPixels = (GPixel*)pixelStorage.detach();
+    if (allocate) {
+        *bitmap = dst;
+    }
     return true;
 }
 
+bool GBitmap::readFromFile(const char path[]) {
+    this->reset();
+    return decode_png(path, this, true, NULL, NULL);
+}
+
+bool GReadPNGSize(const char path[], int* width, int* height) {
+    return decode_png(path, NULL, false, width, height);
+}
+
+bool GDecodePNGInto(const char path[], const GBitmap& dst) {
+    GBitmap bitmap = dst;
+    return decode_png(path, &bitmap, false, NULL, NULL);
+}
@@ -0,0 +1,40 @@
+/**
+ *  PNG entry points beyond GBitmap::readFromFile and writeToFile.
+ */
+
+#ifndef GPNGCodec_DEFINED
+#define GPNGCodec_DEFINED
+
+#include "GBitmap.h"
+
+// Reads only the header of a PNG file.
+bool GReadPNGSize(const char path[], int* width, int* height);
+
+// Decodes a PNG straight into dst's pixels, which must already be sized to the image
+// (see GReadPNGSize). Gray, gray+alpha, palette, RGB and RGBA images of any bit depth,
+// interlaced or not, are decoded to premultiplied GPixels.
+bool GDecodePNGInto(const char path[], const GBitmap& dst);
+
+// Per row filter applied before compression. kAdaptive tries each filter on every row
+// and keeps the one with the smallest sum of absolute differences.
+enum class GPNGFilter {
+    kDefault,       // libpng's choice
+    kNone,
+    kSub,
+    kUp,
+    kAverage,
+    kPaeth,
+    kAdaptive,
+};
+
+struct GPNGEncodeOptions {
+    int        fZLibLevel = -1;     // 0 (store) .. 9 (smallest), -1 for zlib's default
+    GPNGFilter fFilter = GPNGFilter::kDefault;
+    int        fThreads = 1;        // above 1, bands of rows are deflated in parallel on
+                                    // std::thread; link with -pthread
+};
+
+// Writes src as an 8-bit RGBA PNG. writeToFile is this with the default options.
+bool GEncodePNG(const GBitmap& src, const char path[], const GPNGEncodeOptions& options);
+
+#endif
@@ -0,0 +1,150 @@
+/**
+ *  Raw bitmap files, see GRawBitmap.h
+ */
+
+#include "GRawBitmap.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <vector>
+
+#define RAW_VERSION     1
+#define RAW_PAGE_SIZE   4096
+
+static uint32_t pixel_layout() {
+    return (GPIXEL_SHIFT_A << 24) | (GPIXEL_SHIFT_R << 16) | (GPIXEL_SHIFT_G << 8) | GPIXEL_SHIFT_B;
+}
+
+class GAutoClose {
+public:
+    GAutoClose(int fd) : fFD(fd) {}
+    ~GAutoClose() { ::close(fFD); }
+
+private:
+    int fFD;
+};
+
+// writev until every byte of iov is out, stepping past partial writes
+static bool write_all(int fd, struct iovec iov[], int count) {
+    while (count > 0) {
+        ssize_t written = ::writev(fd, iov, count < IOV_MAX ? count : IOV_MAX);
+        if (written < 0) {
+            if (EINTR == errno) {
+                continue;
+            }
+            return false;
+        }
+        while (count > 0 && (size_t)written >= iov->iov_len) {
+            written -= iov->iov_len;
+            ++iov;
+            --count;
+        }
+        if (count > 0) {
+            iov->iov_base = (char*)iov->iov_base + written;
+            iov->iov_len -= written;
+        }
+    }
+    return true;
+}
+
+static void add_iov(std::vector<struct iovec>* iov, const void* base, size_t length) {
+    struct iovec entry;
+    entry.iov_base = (void*)base;
+    entry.iov_len = length;
+    iov->push_back(entry);
+}
+
+bool GWriteRawBitmap(const GBitmap& src, const char path[]) {
+    if (src.fWidth <= 0 || src.fHeight <= 0 || !src.fPixels) {
+        return false;
+    }
+    int fd = ::open(path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (fd < 0) {
+        return false;
+    }
+    GAutoClose ac(fd);
+
+    const size_t rowBytes = src.fWidth * sizeof(GPixel);
+    char page[RAW_PAGE_SIZE];
+    memset(page, 0, sizeof(page));
+    GRawHeader* header = (GRawHeader*)page;
+    memcpy(header->fMagic, "GRAW", 4);
+    header->fVersion = RAW_VERSION;
+    header->fPixelLayout = pixel_layout();
+    header->fWidth = src.fWidth;
+    header->fHeight = src.fHeight;
+    header->fRowBytes = rowBytes;
+    header->fPixelOffset = RAW_PAGE_SIZE;
+
+    // rows are written tightly packed, one iovec for all of them when src already is
+    std::vector<struct iovec> iov;
+    add_iov(&iov, page, sizeof(page));
+    if (src.fRowBytes == rowBytes) {
+        add_iov(&iov, src.fPixels, rowBytes * src.fHeight);
+    } else {
+        for (int y = 0; y < src.fHeight; ++y) {
+            add_iov(&iov, src.getAddr(0, y), rowBytes);
+        }
+    }
+    return write_all(fd, &iov[0], (int)iov.size());
+}
+
+bool GMappedBitmap::map(const char path[]) {
+    this->unmap();
+
+    int fd = ::open(path, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    GAutoClose ac(fd);
+
+    struct stat status;
+    if (fstat(fd, &status) || (size_t)status.st_size < sizeof(GRawHeader)) {
+        return false;
+    }
+    void* base = ::mmap(NULL, status.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (MAP_FAILED == base) {
+        return false;
+    }
+
+    const GRawHeader* header = (const GRawHeader*)base;
+    const uint64_t size = status.st_size;
+    bool valid = !memcmp(header->fMagic, "GRAW", 4) &&
+                 RAW_VERSION == header->fVersion &&
+                 pixel_layout() == header->fPixelLayout &&
+                 header->fWidth > 0 && header->fHeight > 0 &&
+                 header->fRowBytes >= (uint64_t)header->fWidth * sizeof(GPixel) &&
+                 0 == header->fRowBytes % sizeof(GPixel) &&
+                 0 == header->fPixelOffset % sizeof(GPixel) &&
+                 header->fPixelOffset >= sizeof(GRawHeader) && header->fPixelOffset <= size &&
+                 (size - header->fPixelOffset) / header->fRowBytes >= (uint64_t)header->fHeight;
+    if (!valid) {
+        ::munmap(base, status.st_size);
+        return false;
+    }
+
+    fBase = base;
+    fSize = status.st_size;
+    fBitmap.fWidth = header->fWidth;
+    fBitmap.fHeight = header->fHeight;
+    fBitmap.fRowBytes = header->fRowBytes;
+    fBitmap.fPixels = (GPixel*)((char*)base + header->fPixelOffset);
+    return true;
+}
+
+void GMappedBitmap::unmap() {
+    if (fBase) {
+        ::munmap(fBase, fSize);
+    }
+    fBase = NULL;
+    fSize = 0;
+    fBitmap.fWidth = 0;
+    fBitmap.fHeight = 0;
+    fBitmap.fRowBytes = 0;
+    fBitmap.fPixels = NULL;
+}
@@ -0,0 +1,49 @@
+/**
+ *  Uncompressed bitmap files that load without decoding.
+ */
+
+#ifndef GRawBitmap_DEFINED
+#define GRawBitmap_DEFINED
+
+#include "GBitmap.h"
+#include <stdint.h>
+
+// A raw file is one page holding this header, then height rows of fRowBytes
+// premultiplied GPixels, in the byte order of the machine that wrote them.
+struct GRawHeader {
+    char     fMagic[4];         // "GRAW"
+    uint32_t fVersion;
+    uint32_t fPixelLayout;      // GPIXEL_SHIFT_A/R/G/B packed a byte each, rejects foreign layouts
+    int32_t  fWidth;
+    int32_t  fHeight;
+    uint32_t fReserved;
+    uint64_t fRowBytes;
+    uint64_t fPixelOffset;      // page aligned start of the first row
+};
+
+// Writes src as a raw file with one sequential write.
+bool GWriteRawBitmap(const GBitmap& src, const char path[]);
+
+// Maps a raw file read-only. bitmap() points straight at the mapping, so it can be used
+// as a source (e.g. by a shader) without copying, but must never be drawn into.
+class GMappedBitmap {
+public:
+    GMappedBitmap() : fBase(NULL), fSize(0) {}
+    ~GMappedBitmap() { this->unmap(); }
+
+    bool map(const char path[]);
+    void unmap();
+
+    bool isMapped() const { return fBase != NULL; }
+    const GBitmap& bitmap() const { return fBitmap; }
+
+private:
+    GMappedBitmap(const GMappedBitmap&);
+    GMappedBitmap& operator=(const GMappedBitmap&);
+
+    void*   fBase;
+    size_t  fSize;
+    GBitmap fBitmap;
+};
+
+#endif